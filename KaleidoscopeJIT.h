@@ -16,46 +16,116 @@
 
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
 #include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+#include <functional>
 #include <memory>
+#include <string>
+#include "objectcache.h"
 
 namespace llvm {
 namespace orc {
 
+/// ThreadPoolTaskDispatcher - Runs the session's tasks, compiling and linking
+/// modules among them, on a fixed number of threads.
+/// 在固定数量的线程上运行会话的任务，包括编译和链接模块
+class ThreadPoolTaskDispatcher : public TaskDispatcher {
+  ThreadPool Pool;
+
+public:
+  explicit ThreadPoolTaskDispatcher(unsigned Threads)
+      : Pool(hardware_concurrency(Threads)) {}
+
+  void dispatch(std::unique_ptr<Task> T) override {
+    // ThreadPool wants a copyable callable.
+    // ThreadPool要求可以复制的可调用对象
+    std::shared_ptr<Task> Shared(std::move(T));
+    Pool.async([Shared] { Shared->run(); });
+  }
+
+  void shutdown() override { Pool.wait(); }
+};
+
 class KaleidoscopeJIT {
 private:
   std::unique_ptr<ExecutionSession> ES;
 
+  JITTargetMachineBuilder JTMB;
   DataLayout DL;
   MangleAndInterner Mangle;
 
+  std::unique_ptr<DiskObjectCache> Cache;
+
   RTDyldObjectLinkingLayer ObjectLayer;
   IRCompileLayer CompileLayer;
+  IRTransformLayer OptimizeLayer;
+  IRCompileLayer FastCompileLayer; // -O0 code generation (FastISel)
+
+  std::unique_ptr<LazyCallThroughManager> CallThrough;
+  std::unique_ptr<IndirectStubsManager> Stubs;
+  CompileOnDemandLayer LazyLayer;
+  IRTransformLayer LazyOptimizeLayer;
 
   JITDylib &MainJD;
 
+  static JITTargetMachineBuilder withoutOptimization(JITTargetMachineBuilder
+                                                         JTMB) {
+    JTMB.setCodeGenOptLevel(CodeGenOpt::None);
+    return JTMB;
+  }
+
+  /// callThroughFailed - Where a stub goes when its target cannot be
+  /// compiled; the session already reported why.
+  /// 桩的目标无法编译时跳转到这里；会话已经报告了原因
+  static void callThroughFailed() {
+    errs() << "Failed to compile a function on its first call\n";
+    exit(1);
+  }
+
 public:
   KaleidoscopeJIT(std::unique_ptr<ExecutionSession> ES,
-                  JITTargetMachineBuilder JTMB, DataLayout DL)
-      : ES(std::move(ES)), DL(std::move(DL)), Mangle(*this->ES, this->DL),
+                  JITTargetMachineBuilder JTMB, DataLayout DL,
+                  std::unique_ptr<LazyCallThroughManager> CallThrough,
+                  std::unique_ptr<DiskObjectCache> Cache = nullptr)
+      : ES(std::move(ES)), JTMB(std::move(JTMB)), DL(std::move(DL)),
+        Mangle(*this->ES, this->DL), Cache(std::move(Cache)),
         ObjectLayer(*this->ES,
                     []() { return std::make_unique<SectionMemoryManager>(); }),
         CompileLayer(*this->ES, ObjectLayer,
-                     std::make_unique<ConcurrentIRCompiler>(std::move(JTMB))),
+                     std::make_unique<CachingCompiler>(this->JTMB,
+                                                       this->Cache.get())),
+        OptimizeLayer(*this->ES, CompileLayer),
+        FastCompileLayer(*this->ES, ObjectLayer,
+                         std::make_unique<ConcurrentIRCompiler>(
+                             withoutOptimization(this->JTMB))),
+        CallThrough(std::move(CallThrough)),
+        Stubs(createLocalIndirectStubsManagerBuilder(
+            this->JTMB.getTargetTriple())()),
+        LazyLayer(*this->ES, CompileLayer, *this->CallThrough,
+                  createLocalIndirectStubsManagerBuilder(
+                      this->JTMB.getTargetTriple())),
+        LazyOptimizeLayer(*this->ES, LazyLayer),
         MainJD(this->ES->createBareJITDylib("<main>")) {
     MainJD.addGenerator(
         cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(
             DL.getGlobalPrefix())));
-    if (JTMB.getTargetTriple().isOSBinFormatCOFF()) {
+    if (this->JTMB.getTargetTriple().isOSBinFormatCOFF()) {
       ObjectLayer.setOverrideObjectFlagsWithResponsibilityFlags(true);
       ObjectLayer.setAutoClaimResponsibilityForObjectSymbols(true);
     }
@@ -66,8 +136,25 @@ public:
       ES->reportError(std::move(Err));
   }
 
-  static Expected<std::unique_ptr<KaleidoscopeJIT>> Create() {
-    auto EPC = SelfExecutorProcessControl::Create();
+  /// Create - Make a JIT for this process.  With ForHost, code is compiled
+  /// for the host CPU and all of its features (AVX2, AVX-512, ...) instead of
+  /// the generic CPU of the target triple.  With Threads, modules are
+  /// optimized, compiled and linked on that many threads of the JIT's own
+  /// instead of the thread looking up their symbols.  With CacheDir, the
+  /// objects of optimized modules are kept there, up to CacheBytes, for later
+  /// runs to load instead of compiling the same modules again.
+  /// 为当前进程创建JIT。ForHost为真时，按本机CPU和它的全部特性（AVX2、AVX-512等）
+  /// 编译，而不是目标三元组的通用CPU。Threads不为0时，模块在JIT自己的Threads个线程上
+  /// 优化、编译和链接，而不是在查找符号的线程上。CacheDir不为空时，优化过的模块的
+  /// 目标文件保存在那里，最多CacheBytes字节，之后的运行加载它们而不是重新编译同样的模块
+  static Expected<std::unique_ptr<KaleidoscopeJIT>>
+  Create(bool ForHost, unsigned Threads = 0, StringRef CacheDir = "",
+         uint64_t CacheBytes = 0) {
+    std::unique_ptr<TaskDispatcher> Dispatcher;
+    if (Threads)
+      Dispatcher = std::make_unique<ThreadPoolTaskDispatcher>(Threads);
+    auto EPC = SelfExecutorProcessControl::Create(nullptr,
+                                                  std::move(Dispatcher));
     if (!EPC)
       return EPC.takeError();
 
@@ -75,23 +162,143 @@ public:
 
     JITTargetMachineBuilder JTMB(
         ES->getExecutorProcessControl().getTargetTriple());
+    if (ForHost) {
+      auto HostJTMB = JITTargetMachineBuilder::detectHost();
+      if (!HostJTMB)
+        return HostJTMB.takeError();
+      JTMB = std::move(*HostJTMB);
+    }
 
     auto DL = JTMB.getDefaultDataLayoutForTarget();
     if (!DL)
       return DL.takeError();
 
-    return std::make_unique<KaleidoscopeJIT>(std::move(ES), std::move(JTMB),
-                                             std::move(*DL));
+    auto CallThrough = createLocalLazyCallThroughManager(
+        JTMB.getTargetTriple(), *ES,
+        pointerToJITTargetAddress(&callThroughFailed));
+    if (!CallThrough)
+      return CallThrough.takeError();
+
+    // An object only fits the LLVM and the target that produced it; the -O
+    // level already shows in the optimized bitcode.
+    // 目标文件只适用于生成它的LLVM版本和目标机器；-O级别已经体现在优化后的bitcode里
+    std::unique_ptr<DiskObjectCache> Cache;
+    if (!CacheDir.empty())
+      Cache = std::make_unique<DiskObjectCache>(
+          CacheDir, CacheBytes,
+          std::string(LLVM_VERSION_STRING) + " " +
+              JTMB.getTargetTriple().str() + " " + JTMB.getCPU() + " " +
+              JTMB.getFeatures().getString());
+
+    return std::make_unique<KaleidoscopeJIT>(
+        std::move(ES), std::move(JTMB), std::move(*DL),
+        std::move(*CallThrough), std::move(Cache));
   }
 
   const DataLayout &getDataLayout() const { return DL; }
 
+  /// createTargetMachine - A TargetMachine matching the one code is compiled
+  /// for, so IR level optimizations see the same target.
+  /// 创建一个和JIT编译用的一样的TargetMachine，让IR优化看到相同的目标机器
+  Expected<std::unique_ptr<TargetMachine>> createTargetMachine() {
+    return JTMB.createTargetMachine();
+  }
+
   JITDylib &getMainJITDylib() { return MainJD; }
 
-  Error addModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
+  /// getObjectCache - The cache Create was asked for, or null.
+  /// Create时要求的缓存，没有则返回空
+  DiskObjectCache *getObjectCache() { return Cache.get(); }
+
+  /// addModule - Add TSM to the JIT; it goes through setOptimizer when it is
+  /// compiled.  With Fast, it does not, and its machine code is generated at
+  /// -O0 with FastISel, which is quicker to produce but slower to run.
+  /// 把TSM加入JIT；编译时先经过setOptimizer。Fast为真时不经过，并且用FastISel按-O0
+  /// 生成机器码，生成更快但运行更慢
+  Error addModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr,
+                  bool Fast = false) {
+    if (!RT)
+      RT = MainJD.getDefaultResourceTracker();
+    if (Fast)
+      return FastCompileLayer.add(RT, std::move(TSM));
+    return OptimizeLayer.add(RT, std::move(TSM));
+  }
+
+  /// addLazyModule - Add TSM to the JIT, compiling each function it defines
+  /// only when it is first called; until then its name is a stub.  The whole
+  /// module goes through setOptimizer once something refers to one of its
+  /// functions.
+  /// 把TSM加入JIT，它定义的每个函数在第一次被调用时才编译；在那之前函数名是一个桩。
+  /// 有代码引用模块里的某个函数时，整个模块先经过setOptimizer
+  Error addLazyModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
     if (!RT)
       RT = MainJD.getDefaultResourceTracker();
-    return CompileLayer.add(RT, std::move(TSM));
+    return LazyOptimizeLayer.add(RT, std::move(TSM));
+  }
+
+  /// setOptimizer - Run Optimize over each module addModule or addLazyModule
+  /// took, when it is compiled and on the thread compiling it.  By default
+  /// modules are compiled as they are given.
+  /// 在编译addModule或addLazyModule接收的每个模块时，在编译它的线程上对它运行
+  /// Optimize。默认按模块原样编译
+  void setOptimizer(std::function<void(Module &)> Optimize) {
+    auto Transform = [Optimize](ThreadSafeModule TSM,
+                                MaterializationResponsibility &) {
+      TSM.withModuleDo(Optimize);
+      return TSM;
+    };
+    OptimizeLayer.setTransform(Transform);
+    LazyOptimizeLayer.setTransform(Transform);
+  }
+
+  /// compileInBackground - Start compiling the modules defining Names without
+  /// waiting for them.  A failure is reported by the session, and again to
+  /// whoever looks the names up.
+  /// 开始编译定义Names的模块，不等待它们完成。失败由会话报告，之后查找这些名字时也会
+  /// 再次得到错误
+  void compileInBackground(ArrayRef<std::string> Names) {
+    SymbolLookupSet Symbols;
+    for (const std::string &Name : Names)
+      Symbols.add(Mangle(Name));
+    ES->lookup(
+        LookupKind::Static, makeJITDylibSearchOrder(&MainJD),
+        std::move(Symbols), SymbolState::Ready,
+        [](Expected<SymbolMap> Result) { consumeError(Result.takeError()); },
+        NoDependenciesToRegister);
+  }
+
+  /// createStub - Define Name as an indirect stub, a jump through a pointer.
+  /// Target is compiled on the first call through the stub, which then points
+  /// at it until redirectStub points it elsewhere.
+  /// 把Name定义为一个间接桩：通过一个指针跳转。第一次经过桩调用时编译Target，之后桩
+  /// 指向Target，直到redirectStub让它指向别处
+  Error createStub(StringRef Name, StringRef Target) {
+    SymbolAliasMap Aliases;
+    Aliases[Mangle(Name.str())] = SymbolAliasMapEntry(
+        Mangle(Target.str()),
+        JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+    return MainJD.define(
+        lazyReexports(*CallThrough, *Stubs, MainJD, std::move(Aliases)));
+  }
+
+  /// redirectStub - Point the stub Name at Addr.  The pointer is swapped in
+  /// one store, so code calling Name meanwhile runs either the old or the new
+  /// target.
+  /// 让桩Name指向Addr。指针用一次写入替换，同时调用Name的代码要么运行旧目标，
+  /// 要么运行新目标
+  Error redirectStub(StringRef Name, JITTargetAddress Addr) {
+    return Stubs->updatePointer(*Mangle(Name.str()), Addr);
+  }
+
+  /// defineAbsolute - Make JIT'd code calling Name call the host function at
+  /// Addr.
+  /// 让JIT代码里对Name的调用去调用宿主程序里地址为Addr的函数
+  Error defineAbsolute(StringRef Name, void *Addr) {
+    return MainJD.define(absoluteSymbols(
+        {{Mangle(Name.str()),
+          JITEvaluatedSymbol(pointerToJITTargetAddress(Addr),
+                             JITSymbolFlags::Exported |
+                                 JITSymbolFlags::Callable)}}));
   }
 
   Expected<JITEvaluatedSymbol> lookup(StringRef Name) {
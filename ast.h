@@ -1,128 +1,333 @@
 #ifndef AST_H
 #define AST_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "interner.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 //===----------------------------------------------------------------------===//
 // Abstract Syntax Tree (aka Parse Tree)
 // 抽象语法树
 //===----------------------------------------------------------------------===//
 using namespace llvm;
 
+// Expressions are stored flat: every kind of node lives in its own contiguous
+// array inside an ExprPool, and children are referred to by a 32-bit ExprRef
+// (node kind + index into that kind's array).  Code generation dispatches with
+// a switch on the kind instead of a virtual call, and a whole tree can be
+// copied or thrown away as a handful of vectors.
+// 表达式是扁平存储的：每种节点放在ExprPool里各自连续的数组中，子节点用32位的ExprRef
+// （节点种类 + 在该种类数组中的下标）引用。代码生成用switch分发，而不是虚函数调用，
+// 整棵树的拷贝和释放也只是几个vector的事情
+
+/// ValueType - The types of values: every number is a double, except where
+/// inference proves an int (i64) is enough.  An array is a pointer to doubles
+/// together with their count; a vector is 2, 4 or 8 doubles held in SIMD
+/// registers.
+/// 值的类型：所有数字都是double，除非类型推导证明int（i64）就够了。数组是指向double
+/// 的指针加上元素个数；向量是放在SIMD寄存器里的2、4或8个double
+enum class ValueType : uint8_t { Double, Int, Array, Vec2, Vec4, Vec8 };
+
+/// getVectorWidth - The number of lanes of vector type T, 0 for the others.
+/// 向量类型T的通道数，其他类型为0
+inline unsigned getVectorWidth(ValueType T) {
+  switch (T) {
+  case ValueType::Vec2:
+    return 2;
+  case ValueType::Vec4:
+    return 4;
+  case ValueType::Vec8:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/// joinTypes - The type holding values of both A and B.  Numbers order as
+/// int < double < vector, a number joined with a vector being splatted to all
+/// lanes.  Anything joined with an array, or vectors of different widths,
+/// give a type that code generation then reports as a mismatch.
+/// 能同时存放A和B的值的类型。数字的顺序是int < double < 向量，数字和向量的并是把数字
+/// 复制到所有通道。和数组的并以及不同宽度向量的并，代码生成时会报告类型不匹配
+inline ValueType joinTypes(ValueType A, ValueType B) {
+  if (A == B)
+    return A;
+  if (A == ValueType::Array || B == ValueType::Array)
+    return ValueType::Array;
+  if (getVectorWidth(A))
+    return A;
+  if (getVectorWidth(B))
+    return B;
+  return ValueType::Double;
+}
+
+/// FunctionEffects - What a call to a function may do, as far as the
+/// optimizer cares.  The default assumes the worst, as for externs.
+/// 调用一个函数可能产生的效果（就优化器关心的方面而言）。默认假设最坏的情况，比如外部函数
+struct FunctionEffects {
+  enum MemoryKind : uint8_t {
+    NoMemory,    // Touches no memory but its own stack. 只访问自己的栈
+    ReadsMemory, // Reads arrays, writes none. 读数组，不写
+    AnyMemory,
+  };
+  MemoryKind Memory = AnyMemory;
+  bool NoUnwind = false;   // Never unwinds. 不会展开栈
+  bool WillReturn = false; // Always returns: no loops, recursion or traps. 总是返回
+  bool NoRecurse = false;  // Never reenters itself. 不会重入自身
+};
 
+/// joinEffects - The effects of doing both A and B.
+/// 同时做A和B的效果
+inline FunctionEffects joinEffects(FunctionEffects A, FunctionEffects B) {
+  A.Memory = std::max(A.Memory, B.Memory);
+  A.NoUnwind &= B.NoUnwind;
+  A.WillReturn &= B.WillReturn;
+  A.NoRecurse &= B.NoRecurse;
+  return A;
+}
+
+/// ExprKind - The kinds of expression node.
+/// 表达式节点的种类
+enum class ExprKind : uint8_t {
+  Number,   // 数字字面量
+  Variable, // 变量引用
+  Unary,    // 一元表达式
+  Binary,   // 二元表达式
+  Call,     // 函数调用
+  If,       // if/then/else
+  For,      // for/in
+  Var,      // var/in
+  Integer,  // 整数字面量
+  Index,    // 数组下标
+};
+
+/// ExprRef - A reference to an expression node: the kind in the top 4 bits,
+/// the index into that kind's array in the low 28.  A default constructed
+/// ExprRef refers to nothing (e.g. a missing step or a parse error).
+/// 表达式节点的引用：高4位是种类，低28位是在该种类数组中的下标。默认构造的ExprRef
+/// 不引用任何东西（比如没有写的步长或解析错误）
+class ExprRef {
+  static const uint32_t IndexBits = 28;
+  static const uint32_t None = ~0u;
+  uint32_t Bits = None;
 
-/// ExprAST - Base class for all expression nodes.
-/// 所有表达式节点的基类
-class ExprAST {
 public:
-  virtual ~ExprAST() = default;
+  ExprRef() = default;
+  ExprRef(ExprKind K, uint32_t Index)
+      : Bits((uint32_t)K << IndexBits | Index) {
+    assert(Index < (1u << IndexBits) && "too many nodes of one kind");
+  }
 
-  virtual Value *codegen() = 0;
+  explicit operator bool() const { return Bits != None; }
+  ExprKind getKind() const { return (ExprKind)(Bits >> IndexBits); }
+  uint32_t getIndex() const { return Bits & ((1u << IndexBits) - 1); }
 };
 
-/// NumberExprAST - Expression class for numeric literals like "1.0".
-/// 数字字面量的表达式节点
-class NumberExprAST : public ExprAST {
+/// NumberExpr - Numeric literals like "1.0".
+/// 数字字面量
+struct NumberExpr {
   double Val;
-
-public:
-  NumberExprAST(double Val) : Val(Val) {}
-
-  Value *codegen() override;
 };
 
-/// VariableExprAST - Expression class for referencing a variable, like "a".
-/// 变量表达式节点，用来引用一个变量
-class VariableExprAST : public ExprAST {
-  std::string Name;
+/// IntegerExpr - Integer literals like "1".  They are doubles like any other
+/// number, except where they start or step a loop, or meet an int in a
+/// builtin operator or as an index.
+/// 整数字面量。和其他数字一样是double，只有作为循环的起始值或步长，或者在内建操作符里
+/// 和int一起、作为下标时才是int
+struct IntegerExpr {
+  int64_t Val;
+};
 
-public:
-  VariableExprAST(const std::string &Name) : Name(Name) {}
+/// VariableExpr - Referencing a variable, like "a".
+/// 变量引用
+struct VariableExpr {
+  Symbol Name;
+};
 
-  Value *codegen() override;
-  const std::string &getName() const { return Name; }
+/// IndexExpr - Indexing an array variable, like "a[i]".
+/// 数组变量的下标访问
+struct IndexExpr {
+  Symbol Array;
+  ExprRef Index;
 };
 
-/// UnaryExprAST - Expression class for a unary operator.
-/// 一元表达式节点
-class UnaryExprAST : public ExprAST {
+/// UnaryExpr - A unary operator.
+/// 一元表达式
+struct UnaryExpr {
   char Opcode;
-  std::unique_ptr<ExprAST> Operand;
-
-public:
-  UnaryExprAST(char Opcode, std::unique_ptr<ExprAST> Operand)
-      : Opcode(Opcode), Operand(std::move(Operand)) {}
-
-  Value *codegen() override;
+  ExprRef Operand;
 };
 
-/// BinaryExprAST - Expression class for a binary operator.
-/// 二元表达式节点
-class BinaryExprAST : public ExprAST {
+/// BinaryExpr - A binary operator.
+/// 二元表达式
+struct BinaryExpr {
   char Op;
-  std::unique_ptr<ExprAST> LHS, RHS;
-
-public:
-  BinaryExprAST(char Op, std::unique_ptr<ExprAST> LHS,
-                std::unique_ptr<ExprAST> RHS)
-      : Op(Op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
-
-  Value *codegen() override;
+  ExprRef LHS, RHS;
 };
 
-/// CallExprAST - Expression class for function calls.
-/// 函数调用表达式节点
-class CallExprAST : public ExprAST {
-  std::string Callee;
-  std::vector<std::unique_ptr<ExprAST>> Args;
-
-public:
-  CallExprAST(const std::string &Callee,
-              std::vector<std::unique_ptr<ExprAST>> Args)
-      : Callee(Callee), Args(std::move(Args)) {}
+/// CallExpr - Function calls; the arguments are ExprPool::Lists
+/// [FirstArg, FirstArg + NumArgs).
+/// 函数调用，参数在ExprPool::Lists的[FirstArg, FirstArg + NumArgs)区间
+struct CallExpr {
+  Symbol Callee;
+  uint32_t FirstArg, NumArgs;
+};
 
-  Value *codegen() override;
+/// IfExpr - if/then/else.
+/// if/then/else条件判断
+struct IfExpr {
+  ExprRef Cond, Then, Else;
 };
 
-/// IfExprAST - Expression class for if/then/else.
-/// if/then/else条件判断表达式节点
-class IfExprAST : public ExprAST {
-  std::unique_ptr<ExprAST> Cond, Then, Else;
+/// ForExpr - for/in.  Step is empty when not written.
+/// for/in循环，没有写步长时Step为空
+struct ForExpr {
+  Symbol VarName;
+  ExprRef Start, End, Step, Body;
+};
 
-public:
-  IfExprAST(std::unique_ptr<ExprAST> Cond, std::unique_ptr<ExprAST> Then,
-            std::unique_ptr<ExprAST> Else)
-      : Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
+/// VarBinding - One "name = init" of a var/in; Init is empty when omitted.
+/// For a stack array "name[size]", Init is the size.
+/// var/in中的一个"name = init"，没有初始化时Init为空。栈上数组"name[size]"的Init是大小
+struct VarBinding {
+  Symbol Name;
+  ExprRef Init;
+  bool IsArray = false;
+};
 
-  Value *codegen() override;
+/// VarExpr - var/in; the bindings are ExprPool::Bindings
+/// [FirstBinding, FirstBinding + NumBindings).
+/// 变量定义，绑定在ExprPool::Bindings的[FirstBinding, FirstBinding + NumBindings)区间
+struct VarExpr {
+  uint32_t FirstBinding, NumBindings;
+  ExprRef Body;
 };
 
-/// ForExprAST - Expression class for for/in.
-/// for/in 循环表达式节点
-class ForExprAST : public ExprAST {
-  std::string VarName;
-  std::unique_ptr<ExprAST> Start, End, Step, Body;
+/// ExprPool - All expression nodes of one top-level item.
+/// 一个顶层结构的所有表达式节点
+class ExprPool {
+  std::vector<NumberExpr> Numbers;
+  std::vector<VariableExpr> Variables;
+  std::vector<UnaryExpr> Unaries;
+  std::vector<BinaryExpr> Binaries;
+  std::vector<CallExpr> Calls;
+  std::vector<IfExpr> Ifs;
+  std::vector<ForExpr> Fors;
+  std::vector<VarExpr> Vars;
+  std::vector<IntegerExpr> Integers;
+  std::vector<IndexExpr> Indices;
+  std::vector<ExprRef> Lists;         // Call arguments. 函数调用参数
+  std::vector<VarBinding> Bindings;   // var/in bindings. 变量绑定
+
+  template <typename T>
+  static ExprRef add(std::vector<T> &Nodes, ExprKind K, const T &Node) {
+    Nodes.push_back(Node);
+    return ExprRef(K, Nodes.size() - 1);
+  }
 
 public:
-  ForExprAST(const std::string &VarName, std::unique_ptr<ExprAST> Start,
-             std::unique_ptr<ExprAST> End, std::unique_ptr<ExprAST> Step,
-             std::unique_ptr<ExprAST> Body)
-      : VarName(VarName), Start(std::move(Start)), End(std::move(End)),
-        Step(std::move(Step)), Body(std::move(Body)) {}
+  ExprRef addNumber(double Val) {
+    return add(Numbers, ExprKind::Number, {Val});
+  }
+  ExprRef addInteger(int64_t Val) {
+    return add(Integers, ExprKind::Integer, {Val});
+  }
+  ExprRef addIndex(Symbol Array, ExprRef Index) {
+    return add(Indices, ExprKind::Index, {Array, Index});
+  }
+  ExprRef addVariable(Symbol Name) {
+    return add(Variables, ExprKind::Variable, {Name});
+  }
+  ExprRef addUnary(char Opcode, ExprRef Operand) {
+    return add(Unaries, ExprKind::Unary, {Opcode, Operand});
+  }
+  ExprRef addBinary(char Op, ExprRef LHS, ExprRef RHS) {
+    return add(Binaries, ExprKind::Binary, {Op, LHS, RHS});
+  }
+  ExprRef addCall(Symbol Callee, ArrayRef<ExprRef> Args) {
+    uint32_t First = Lists.size();
+    Lists.insert(Lists.end(), Args.begin(), Args.end());
+    return add(Calls, ExprKind::Call, {Callee, First, (uint32_t)Args.size()});
+  }
+  ExprRef addIf(ExprRef Cond, ExprRef Then, ExprRef Else) {
+    return add(Ifs, ExprKind::If, {Cond, Then, Else});
+  }
+  ExprRef addFor(Symbol VarName, ExprRef Start, ExprRef End, ExprRef Step,
+                 ExprRef Body) {
+    return add(Fors, ExprKind::For, {VarName, Start, End, Step, Body});
+  }
+  ExprRef addVar(ArrayRef<VarBinding> VarNames, ExprRef Body) {
+    uint32_t First = Bindings.size();
+    Bindings.insert(Bindings.end(), VarNames.begin(), VarNames.end());
+    return add(Vars, ExprKind::Var,
+               {First, (uint32_t)VarNames.size(), Body});
+  }
 
-  Value *codegen() override;
-};
+  const NumberExpr &getNumber(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Number);
+    return Numbers[E.getIndex()];
+  }
+  const IntegerExpr &getInteger(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Integer);
+    return Integers[E.getIndex()];
+  }
+  const IndexExpr &getIndex(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Index);
+    return Indices[E.getIndex()];
+  }
+  const VariableExpr &getVariable(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Variable);
+    return Variables[E.getIndex()];
+  }
+  const UnaryExpr &getUnary(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Unary);
+    return Unaries[E.getIndex()];
+  }
+  const BinaryExpr &getBinary(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Binary);
+    return Binaries[E.getIndex()];
+  }
+  const CallExpr &getCall(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Call);
+    return Calls[E.getIndex()];
+  }
+  const IfExpr &getIf(ExprRef E) const {
+    assert(E.getKind() == ExprKind::If);
+    return Ifs[E.getIndex()];
+  }
+  const ForExpr &getFor(ExprRef E) const {
+    assert(E.getKind() == ExprKind::For);
+    return Fors[E.getIndex()];
+  }
+  const VarExpr &getVar(ExprRef E) const {
+    assert(E.getKind() == ExprKind::Var);
+    return Vars[E.getIndex()];
+  }
 
-/// VarExprAST - Expression class for var/in
-/// 变量定义表达式节点
-class VarExprAST : public ExprAST {
-  std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames;
-  std::unique_ptr<ExprAST> Body;
+  ArrayRef<ExprRef> getArgs(const CallExpr &Call) const {
+    return makeArrayRef(Lists).slice(Call.FirstArg, Call.NumArgs);
+  }
+  ArrayRef<VarBinding> getBindings(const VarExpr &Var) const {
+    return makeArrayRef(Bindings).slice(Var.FirstBinding, Var.NumBindings);
+  }
 
-public:
-  VarExprAST(
-      std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames,
-      std::unique_ptr<ExprAST> Body)
-      : VarNames(std::move(VarNames)), Body(std::move(Body)) {}
+  /// size - Total number of expression nodes.
+  /// 表达式节点的总数
+  size_t size() const {
+    return Numbers.size() + Variables.size() + Unaries.size() +
+           Binaries.size() + Calls.size() + Ifs.size() + Fors.size() +
+           Vars.size() + Integers.size() + Indices.size();
+  }
 
-  Value *codegen() override;
+  /// numBindings - Number of var/in bindings; they are numbered
+  /// [0, numBindings()) in the order they were added.
+  /// var/in绑定的个数，按添加顺序编号为[0, numBindings())
+  size_t numBindings() const { return Bindings.size(); }
+  size_t numFors() const { return Fors.size(); }
 };
 
 /// PrototypeAST - This class represents the "prototype" for a function,
@@ -130,45 +335,91 @@ public:
 /// of arguments the function takes), as well as if it is an operator.
 /// 函数原型表达式节点，此类表示函数的“原型”，它捕获其名称和参数名称（因此隐式地表示函数接受的参数数量），以及是否为运算符。
 class PrototypeAST {
-  std::string Name;
-  std::vector<std::string> Args;
+  Symbol Name;
+  std::vector<Symbol> Args;
+  std::vector<ValueType> ArgTypes;
+  ValueType ReturnType = ValueType::Double;
   bool IsOperator;
   unsigned Precedence; // Precedence if a binary op. 二元操作符的优先级
+  bool Fast = false;   // Defined with 'def fast'. 用'def fast'定义的
+  bool Extern = false; // Declared with 'extern'. 用'extern'声明的
+  bool Memo = false;   // Defined with 'def memo'. 用'def memo'定义的
+  FunctionEffects Effects;
 
 public:
-  PrototypeAST(const std::string &Name, std::vector<std::string> Args,
-               bool IsOperator = false, unsigned Prec = 0)
-      : Name(Name), Args(std::move(Args)), IsOperator(IsOperator),
-        Precedence(Prec) {}
+  /// PrototypeAST - ArgTypes may be left empty when every argument is a
+  /// double.
+  /// 参数都是double时ArgTypes可以为空
+  PrototypeAST(Symbol Name, std::vector<Symbol> Args,
+               bool IsOperator = false, unsigned Prec = 0,
+               std::vector<ValueType> ArgTypes = {})
+      : Name(Name), Args(std::move(Args)), ArgTypes(std::move(ArgTypes)),
+        IsOperator(IsOperator), Precedence(Prec) {
+    this->ArgTypes.resize(this->Args.size(), ValueType::Double);
+  }
 
   Function *codegen();
-  const std::string &getName() const { return Name; }
+  Symbol getName() const { return Name; }
+  const std::vector<Symbol> &getArgs() const { return Args; }
+  const std::vector<ValueType> &getArgTypes() const { return ArgTypes; }
+
+  /// getReturnType/setReturnType - Externs return a double; definitions
+  /// return whatever type inference finds for their body.
+  /// 外部函数返回double；函数定义返回类型推导为函数体得出的类型
+  ValueType getReturnType() const { return ReturnType; }
+  void setReturnType(ValueType T) { ReturnType = T; }
 
   bool isUnaryOp() const { return IsOperator && Args.size() == 1; }
   bool isBinaryOp() const { return IsOperator && Args.size() == 2; }
 
   char getOperatorName() const {
     assert(isUnaryOp() || isBinaryOp());
-    return Name[Name.size() - 1];
+    return Symbols.getName(Name).back();
   }
 
   unsigned getBinaryPrecedence() const { return Precedence; }
+
+  /// isFast/setFast - Whether the body may use fast-math transformations.
+  /// 函数体是否可以使用fast-math变换
+  bool isFast() const { return Fast; }
+  void setFast() { Fast = true; }
+
+  /// isExtern/setExtern - Whether this declares a function defined outside,
+  /// e.g. in libm.
+  /// 是否声明了一个在外部（比如libm里）定义的函数
+  bool isExtern() const { return Extern; }
+  void setExtern() { Extern = true; }
+
+  /// isMemo/setMemo - Whether calls go through a cache of earlier results.
+  /// 调用是否经过保存先前结果的缓存
+  bool isMemo() const { return Memo; }
+  void setMemo() { Memo = true; }
+
+  /// getEffects/setEffects - Externs may do anything; definitions do what
+  /// effect analysis finds for their body.
+  /// 外部函数可能做任何事；函数定义的效果由效果分析根据函数体得出
+  const FunctionEffects &getEffects() const { return Effects; }
+  void setEffects(FunctionEffects E) { Effects = E; }
 };
 
-/// FunctionAST - This class represents a function definition itself.
-/// 函数定义表达式节点，代表一个函数的定义
+/// FunctionAST - This class represents a function definition itself: the
+/// prototype and the pool holding the body.  The prototype is kept separately
+/// because it outlives the body in FunctionProtos.
+/// 函数定义表达式节点，代表一个函数的定义：原型和存放函数体的节点池。
+/// 原型单独分配，因为它在FunctionProtos里比函数体活得更久
 class FunctionAST {
   std::unique_ptr<PrototypeAST> Proto;
-  std::unique_ptr<ExprAST> Body;
+  ExprPool Pool;
+  ExprRef Body;
 
 public:
-  FunctionAST(std::unique_ptr<PrototypeAST> Proto,
-              std::unique_ptr<ExprAST> Body)
-      : Proto(std::move(Proto)), Body(std::move(Body)) {}
+  FunctionAST(std::unique_ptr<PrototypeAST> Proto, ExprPool Pool, ExprRef Body)
+      : Proto(std::move(Proto)), Pool(std::move(Pool)), Body(Body) {}
 
   Function *codegen();
+  const PrototypeAST &getProto() const { return *Proto; }
+  const ExprPool &getPool() const { return Pool; }
+  ExprRef getBody() const { return Body; }
 };
 
-
-
-#endif // AST_H
\ No newline at end of file
+#endif // AST_H
@@ -14,39 +14,138 @@
 #include <utility>
 #include <vector>
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
-#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Scalar/GVN.h"
-#include "llvm/Transforms/Utils.h"
 #include "ast.h"
 #include "parser.h"
 #include "lexer.h"
 #include "helper.h"
+#include "symtab.h"
 #include "codegen.h"
-
+#include "effects.h"
+#include "options.h"
+#include "types.h"
+
+static cl::opt<unsigned> ImportLimit(
+    "import-limit",
+    cl::desc("Copy bodies of earlier definitions with at most N expression "
+             "nodes into the modules calling them, so they can be inlined "
+             "(0 = never, default 64)"),
+    cl::init(64), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> FastMath(
+    "fast-math",
+    cl::desc("Allow fast-math transformations (reassociation, FMA "
+             "contraction, reciprocals) in every function, not only in "
+             "'def fast' ones"),
+    cl::init(false), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> InlineOperators(
+    "inline-operators",
+    cl::desc("Expand user defined operators at their use sites instead of "
+             "calling them (default true)"),
+    cl::init(true), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> BoundsChecks(
+    "bounds-checks",
+    cl::desc("Check array indices and trap when one is out of bounds "
+             "(default true)"),
+    cl::init(true), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<unsigned> MemoEntries(
+    "memo-entries",
+    cl::desc("Size of the result cache of each 'def memo' function, rounded "
+             "up to a power of two (default 4096)"),
+    cl::init(4096), cl::cat(KaleidoscopeCategory));
 
 std::unique_ptr<LLVMContext> TheContext;
 std::unique_ptr<Module> TheModule;
 std::unique_ptr<IRBuilder<>> Builder;
-std::map<std::string, AllocaInst *> NamedValues;
-std::unique_ptr<legacy::FunctionPassManager> TheFPM;
+ScopedSymbolTable<AllocaInst *> NamedValues;
 std::unique_ptr<KaleidoscopeJIT> TheJIT;
-std::map<std::string, std::unique_ptr<PrototypeAST>> FunctionProtos;
+SymbolTable<std::unique_ptr<PrototypeAST>> FunctionProtos;
 ExitOnError ExitOnErr;
+unsigned ModuleGeneration = 0;
+
+/// ModuleFunctions - The Function each symbol names in TheModule, tagged with
+/// the ModuleGeneration it belongs to, so opening a new module invalidates the
+/// whole table without touching it.
+/// 每个符号在TheModule中对应的函数，带上所属模块的代数，打开新模块时整张表自动失效
+static SymbolTable<std::pair<unsigned, Function *>> ModuleFunctions;
+
+static Function *&moduleFunction(Symbol Name) {
+  auto &Entry = ModuleFunctions[Name];
+  if (Entry.first != ModuleGeneration)
+    Entry = {ModuleGeneration, nullptr};
+  return Entry.second;
+}
+
+/// KeptBodies - Bodies of the user defined operators and of the definitions
+/// no larger than -import-limit.
+/// 用户定义操作符和不超过-import-limit的函数定义的函数体
+static SymbolTable<std::unique_ptr<KeptBody>> KeptBodies;
+
+/// isImportable - Whether calls to Name get a copy of its body.
+/// 调用Name时是否导入它的函数体副本
+static bool isImportable(Symbol Name) {
+  auto &Kept = KeptBodies.lookup(Name);
+  return Kept && Kept->Pool.size() <= ImportLimit;
+}
+
+SymbolTable<unsigned> ExpandingOperators;
+
+const KeptBody *getOperatorExpansion(Symbol Name) {
+  auto &Kept = KeptBodies.lookup(Name);
+  if (!InlineOperators || !Kept || ExpandingOperators.lookup(Name))
+    return nullptr;
+  return Kept.get();
+}
+
+/// PendingImports - Functions declared in TheModule that have an importable
+/// body; their copies are emitted once the function being generated is done.
+/// TheModule里声明了、并且有可导入函数体的函数；等当前函数生成完再输出它们的副本
+static std::vector<Symbol> PendingImports;
+
+/// PendingEffects - Memo functions defined in TheModule and the effects of
+/// their bodies.  Calls in TheModule may inline a wrapper, which writes the
+/// memo table, so only later modules may assume them.
+/// TheModule里定义的memo函数和它们函数体的效果。TheModule里的调用可能内联会写结果表
+/// 的包装，所以只有之后的模块才能假设这些效果
+static std::vector<std::pair<Symbol, FunctionEffects>> PendingEffects;
+
+void publishEffects() {
+  for (auto &Pending : PendingEffects)
+    if (auto &P = FunctionProtos.lookup(Pending.first))
+      P->setEffects(Pending.second);
+  PendingEffects.clear();
+}
+
+Symbol getOperatorSymbol(bool IsBinary, char Op) {
+  static Symbol Cache[2][256];
+  static bool Known[2][256];
+  unsigned char C = Op;
+  if (!Known[IsBinary][C]) {
+    std::string Name = IsBinary ? "binary" : "unary";
+    Name += Op;
+    Cache[IsBinary][C] = Symbols.intern(Name);
+    Known[IsBinary][C] = true;
+  }
+  return Cache[IsBinary][C];
+}
 
 Value *LogErrorV(const char *Str) {
   LogError(Str);
@@ -54,110 +153,581 @@ Value *LogErrorV(const char *Str) {
 }
 
 // 查找函数
-Function *getFunction(std::string Name) {
+Function *getFunction(Symbol Name) {
   // First, see if the function has already been added to the current module.
   // 当前模块找到，直接返回
-  if (auto *F = TheModule->getFunction(Name))
+  if (auto *F = moduleFunction(Name))
     return F;
 
   // If not, check whether we can codegen the declaration from some existing
   // prototype.
   // 否则看看原型里面有没有，有的话，直接代码生成（声明）这个原型
-  auto FI = FunctionProtos.find(Name);
-  if (FI != FunctionProtos.end())
-    return FI->second->codegen();
+  if (auto &Proto = FunctionProtos.lookup(Name)) {
+    if (isImportable(Name))
+      PendingImports.push_back(Name);
+    return Proto->codegen();
+  }
 
   // If no existing prototype exists, return null.
   // 没有返回空
   return nullptr;
 }
 
+Intrinsic::ID getMathIntrinsic(Symbol Callee, size_t NumArgs) {
+  static const struct {
+    const char *Name;
+    unsigned NumArgs;
+    Intrinsic::ID ID;
+  } MathFunctions[] = {
+      {"sin", 1, Intrinsic::sin},         {"cos", 1, Intrinsic::cos},
+      {"exp", 1, Intrinsic::exp},         {"exp2", 1, Intrinsic::exp2},
+      {"log", 1, Intrinsic::log},         {"log2", 1, Intrinsic::log2},
+      {"log10", 1, Intrinsic::log10},     {"sqrt", 1, Intrinsic::sqrt},
+      {"fabs", 1, Intrinsic::fabs},       {"floor", 1, Intrinsic::floor},
+      {"ceil", 1, Intrinsic::ceil},       {"trunc", 1, Intrinsic::trunc},
+      {"round", 1, Intrinsic::round},     {"rint", 1, Intrinsic::rint},
+      {"pow", 2, Intrinsic::pow},         {"fmin", 2, Intrinsic::minnum},
+      {"fmax", 2, Intrinsic::maxnum},     {"copysign", 2, Intrinsic::copysign},
+      {"fma", 3, Intrinsic::fma},
+  };
+  static SymbolTable<std::pair<unsigned, Intrinsic::ID>> Table = [] {
+    SymbolTable<std::pair<unsigned, Intrinsic::ID>> T;
+    for (const auto &F : MathFunctions)
+      T[Symbols.intern(F.Name)] = {F.NumArgs, F.ID};
+    return T;
+  }();
+
+  const auto &Entry = Table.lookup(Callee);
+  if (Entry.second == Intrinsic::not_intrinsic || Entry.first != NumArgs)
+    return Intrinsic::not_intrinsic;
+  auto &Proto = FunctionProtos.lookup(Callee);
+  if (!Proto || !Proto->isExtern() ||
+      !llvm::all_of(Proto->getArgTypes(),
+                    [](ValueType T) { return T == ValueType::Double; }))
+    return Intrinsic::not_intrinsic;
+  return Entry.second;
+}
+
+/// getFastMathFlags - The flags for floating point code in the body of Proto.
+/// Proto函数体里浮点运算使用的标志
+static FastMathFlags getFastMathFlags(const PrototypeAST &Proto) {
+  FastMathFlags FMF;
+  if (FastMath || Proto.isFast())
+    FMF.setFast();
+  return FMF;
+}
+
+/// getArrayType - The LLVM type of arrays: { double*, i64 }, the elements and
+/// their count.  It is passed and returned by value.
+/// 数组的LLVM类型：{ double*, i64 }，即元素和元素个数。按值传递和返回
+static StructType *getArrayType() {
+  return StructType::get(Type::getDoublePtrTy(*TheContext),
+                         Type::getInt64Ty(*TheContext));
+}
+
+/// getType - The LLVM type of values of type T.
+/// 类型T的值对应的LLVM类型
+static Type *getType(ValueType T) {
+  if (unsigned Width = getVectorWidth(T))
+    return FixedVectorType::get(Type::getDoubleTy(*TheContext), Width);
+  switch (T) {
+  case ValueType::Int:
+    return Type::getInt64Ty(*TheContext);
+  case ValueType::Array:
+    return getArrayType();
+  default:
+    break;
+  }
+  return Type::getDoubleTy(*TheContext);
+}
+
+/// getValueType - The type of the values of LLVM type Ty.
+/// LLVM类型Ty的值的类型
+static ValueType getValueType(Type *Ty) {
+  if (auto *VecTy = dyn_cast<FixedVectorType>(Ty))
+    return VecTy->getNumElements() == 2   ? ValueType::Vec2
+           : VecTy->getNumElements() == 4 ? ValueType::Vec4
+                                          : ValueType::Vec8;
+  if (Ty->isStructTy())
+    return ValueType::Array;
+  return Ty->isIntegerTy() ? ValueType::Int : ValueType::Double;
+}
+
+/// convertTo - Convert V to type Ty: an int widens to a double, a double is
+/// truncated to an int, saturating like the interpreter, and a number is
+/// splatted to every lane of a vector.  Other conversions are reported, and
+/// null returned.
+/// 把V转换为类型Ty：int扩展为double，double截断为int（和解释器一样取饱和值），数字复制
+/// 到向量的每个通道。其他转换报告错误并返回空
+static Value *convertTo(Value *V, Type *Ty) {
+  if (V->getType() == Ty)
+    return V;
+  if (Ty->isStructTy())
+    return LogErrorV("Type mismatch: expected an array");
+  if (!V->getType()->isIntegerTy() && !V->getType()->isDoubleTy())
+    return LogErrorV(V->getType()->isStructTy()
+                         ? "Type mismatch: expected a number"
+                     : Ty->isVectorTy()
+                         ? "Type mismatch: vector of another width"
+                         : "Type mismatch: expected a number, not a vector");
+  if (auto *VecTy = dyn_cast<FixedVectorType>(Ty)) {
+    V = convertTo(V, VecTy->getElementType());
+    return Builder->CreateVectorSplat(VecTy->getNumElements(), V, "splat");
+  }
+  if (Ty->isDoubleTy())
+    return Builder->CreateSIToFP(V, Ty, "tofp");
+  // NaN becomes 0 and out of range values the nearest int, not poison.
+  // Constants are folded here, since the builder does not fold intrinsics.
+  // NaN变成0，超出范围的值变成最接近的int，而不是poison。常量在这里折叠，因为
+  // IRBuilder不折叠intrinsic
+  if (auto *C = dyn_cast<ConstantFP>(V)) {
+    APSInt Int(Ty->getIntegerBitWidth(), /*isUnsigned=*/false);
+    bool IsExact;
+    C->getValueAPF().convertToInteger(Int, APFloat::rmTowardZero, &IsExact);
+    return ConstantInt::get(Ty, Int);
+  }
+  return Builder->CreateIntrinsic(Intrinsic::fptosi_sat, {Ty, V->getType()},
+                                  {V}, nullptr, "toint");
+}
+
+/// isTrue - Compare V, of either number type, not equal to zero.
+/// 把任意数字类型的V和零比较是否不相等
+static Value *isTrue(Value *V, const Twine &Name) {
+  if (!V->getType()->isIntegerTy() && !V->getType()->isDoubleTy())
+    return LogErrorV("Type mismatch: expected a number");
+  if (V->getType()->isIntegerTy())
+    return Builder->CreateICmpNE(V, ConstantInt::get(V->getType(), 0), Name);
+  return Builder->CreateFCmpONE(V, ConstantFP::get(V->getType(), 0.0), Name);
+}
+
 /// CreateEntryBlockAlloca - Create an alloca instruction in the entry block of
 /// the function.  This is used for mutable variables etc.
 /// 生成一个alloca指令到函数的入口，专门用来给可变变量使用
-AllocaInst *CreateEntryBlockAlloca(Function *TheFunction,
-                                          StringRef VarName) {
+AllocaInst *CreateEntryBlockAlloca(Function *TheFunction, StringRef VarName,
+                                   ValueType T) {
   IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
                    TheFunction->getEntryBlock().begin());
-  return TmpB.CreateAlloca(Type::getDoubleTy(*TheContext), nullptr, VarName);
+  return TmpB.CreateAlloca(getType(T), nullptr, VarName);
+}
+
+/// assignsTo - Whether E contains an assignment to a variable called Name.
+/// Inner scopes are not told apart, so a shadowing variable counts too.
+/// E里是否有对名为Name的变量的赋值。不区分内层作用域，遮盖它的同名变量也算
+static bool assignsTo(const ExprPool &Pool, ExprRef E, Symbol Name) {
+  if (!E)
+    return false;
+  switch (E.getKind()) {
+  case ExprKind::Number:
+  case ExprKind::Integer:
+  case ExprKind::Variable:
+    return false;
+  case ExprKind::Index:
+    return assignsTo(Pool, Pool.getIndex(E).Index, Name);
+  case ExprKind::Unary:
+    return assignsTo(Pool, Pool.getUnary(E).Operand, Name);
+  case ExprKind::Binary: {
+    const BinaryExpr &B = Pool.getBinary(E);
+    if (B.Op == '=' && B.LHS.getKind() == ExprKind::Variable &&
+        Pool.getVariable(B.LHS).Name == Name)
+      return true;
+    return assignsTo(Pool, B.LHS, Name) || assignsTo(Pool, B.RHS, Name);
+  }
+  case ExprKind::Call:
+    for (ExprRef Arg : Pool.getArgs(Pool.getCall(E)))
+      if (assignsTo(Pool, Arg, Name))
+        return true;
+    return false;
+  case ExprKind::If: {
+    const IfExpr &I = Pool.getIf(E);
+    return assignsTo(Pool, I.Cond, Name) || assignsTo(Pool, I.Then, Name) ||
+           assignsTo(Pool, I.Else, Name);
+  }
+  case ExprKind::For: {
+    const ForExpr &F = Pool.getFor(E);
+    return assignsTo(Pool, F.Start, Name) || assignsTo(Pool, F.End, Name) ||
+           assignsTo(Pool, F.Step, Name) || assignsTo(Pool, F.Body, Name);
+  }
+  case ExprKind::Var: {
+    const VarExpr &V = Pool.getVar(E);
+    for (const VarBinding &B : Pool.getBindings(V))
+      if (assignsTo(Pool, B.Init, Name))
+        return true;
+    return assignsTo(Pool, V.Body, Name);
+  }
+  }
+  llvm_unreachable("unknown expression kind");
+}
+
+/// isLoopInvariant - Whether E is built only from numbers, variables that
+/// Loop neither declares nor assigns, and the side effect free builtin
+/// operators and len(), so evaluating it once before the loop gives the same
+/// value as evaluating it on every iteration.  Storing to an element does not
+/// change an array's length.
+/// E是否只由数字、循环既不定义也不赋值的变量、没有副作用的内建操作符和len()组成，这样在
+/// 循环前求值一次和每次迭代都求值的结果相同。给元素赋值不会改变数组的长度
+static bool isLoopInvariant(const ExprPool &Pool, ExprRef E,
+                            const ForExpr &Loop) {
+  switch (E.getKind()) {
+  case ExprKind::Number:
+  case ExprKind::Integer:
+    return true;
+  case ExprKind::Variable: {
+    Symbol Name = Pool.getVariable(E).Name;
+    return Name != Loop.VarName && !assignsTo(Pool, Loop.Body, Name);
+  }
+  case ExprKind::Binary: {
+    const BinaryExpr &B = Pool.getBinary(E);
+    return (B.Op == '+' || B.Op == '-' || B.Op == '*' || B.Op == '<') &&
+           isLoopInvariant(Pool, B.LHS, Loop) &&
+           isLoopInvariant(Pool, B.RHS, Loop);
+  }
+  case ExprKind::Call: {
+    const CallExpr &C = Pool.getCall(E);
+    return getBuiltin(C.Callee, C.NumArgs) == Builtin::Len &&
+           isLoopInvariant(Pool, Pool.getArgs(C)[0], Loop);
+  }
+  default:
+    return false;
+  }
+}
+
+/// MaxExactInteger - Doubles represent every integer up to 2^53 exactly.
+/// double可以精确表示2^53以内的所有整数
+static const double MaxExactInteger = 9007199254740992.0;
+
+/// getIntegralConstant - If E is a literal holding an integer in [Min, Max],
+/// store it to Val.
+/// 如果E是值为[Min, Max]内整数的字面量，把它存到Val
+static bool getIntegralConstant(const ExprPool &Pool, ExprRef E, double Min,
+                                double Max, int64_t &Val) {
+  if (E.getKind() == ExprKind::Integer) {
+    Val = Pool.getInteger(E).Val;
+    return Val >= Min && Val <= Max;
+  }
+  if (E.getKind() != ExprKind::Number)
+    return false;
+  double D = Pool.getNumber(E).Val;
+  if (!(D >= Min && D <= Max) || D != (double)(int64_t)D)
+    return false;
+  Val = (int64_t)D;
+  return true;
+}
+
+/// makeArray - Pack a pointer to Len doubles into an array value.
+/// 把指向Len个double的指针打包成数组值
+static Value *makeArray(Value *Elts, Value *Len) {
+  Value *A = UndefValue::get(getArrayType());
+  A = Builder->CreateInsertValue(A, Elts, 0);
+  return Builder->CreateInsertValue(A, Len, 1, "array");
+}
+
+/// emitBoundsCheck - Continue in a new block if InRange holds, and trap
+/// otherwise.
+/// InRange成立时在新块里继续，否则触发trap
+static void emitBoundsCheck(Value *InRange) {
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  BasicBlock *TrapBB =
+      BasicBlock::Create(*TheContext, "outofbounds", TheFunction);
+  BasicBlock *OkBB = BasicBlock::Create(*TheContext, "inbounds", TheFunction);
+  Builder->CreateCondBr(InRange, OkBB, TrapBB);
+
+  Builder->SetInsertPoint(TrapBB);
+  Builder->CreateIntrinsic(Intrinsic::trap, {}, {});
+  Builder->CreateUnreachable();
+  Builder->SetInsertPoint(OkBB);
+}
+
+/// setMustProgress - Mark the loop whose latch ends in Br as required to make
+/// progress, so it may be deleted when its result is unused.
+/// 标记以Br结尾的循环必须向前推进，这样结果没有被使用时可以删掉它
+static void setMustProgress(BranchInst *Br) {
+  LLVMContext &C = *TheContext;
+  Metadata *Ops[] = {
+      nullptr, MDNode::get(C, MDString::get(C, "llvm.loop.mustprogress"))};
+  MDNode *LoopID = MDNode::getDistinct(C, Ops);
+  LoopID->replaceOperandWith(0, LoopID);
+  Br->setMetadata(LLVMContext::MD_loop, LoopID);
+}
+
+namespace {
+/// ExprCodegen - Emits IR for the expressions of one ExprPool at the current
+/// insertion point of Builder.
+/// 把一个节点池里的表达式生成IR，插入到Builder当前的位置
+class ExprCodegen {
+  const ExprPool &Pool;
+  const FunctionTypes &Types;
+
+  /// SafeIndex - Inside a counted loop bounded by len(Array), indexing Array
+  /// with the loop variable Var is in bounds exactly when InBounds holds, a
+  /// condition computed once before the loop.
+  /// 在以len(Array)为界的计数循环里，用循环变量Var做Array的下标是否越界只取决于
+  /// InBounds，它在进入循环前计算一次
+  struct SafeIndex {
+    AllocaInst *Var, *Array;
+    Value *InBounds;
+  };
+  SmallVector<SafeIndex, 4> SafeIndices;
+
+  /// TailRecurse - Where a self-recursive call in tail position jumps, after
+  /// storing its arguments to the parameter variables; null in operator
+  /// expansions, which are not the function being called.
+  /// 尾位置的自递归调用把参数存到参数变量后跳转到这里；操作符展开时为空，因为展开的
+  /// 代码不属于被调用的函数
+  BasicBlock *TailRecurse;
+  ArrayRef<AllocaInst *> Params;
+
+  Value *codegen(const NumberExpr &E);
+  Value *codegen(const IntegerExpr &E, bool AsInt = false);
+  Value *codegen(const VariableExpr &E);
+  Value *codegen(const UnaryExpr &E);
+  Value *codegen(const BinaryExpr &E);
+  Value *codegen(const CallExpr &E, bool Tail);
+  Value *codegen(const IfExpr &E, bool Tail);
+  Value *codegen(const ForExpr &E, ValueType VarType);
+  Value *codegen(const VarExpr &E, bool Tail);
+  Value *codegen(const IndexExpr &E);
+
+  Value *codegenElementPtr(const IndexExpr &E);
+  Value *codegenBuiltin(Builtin B, ArrayRef<ExprRef> Args);
+  Value *codegenMath(Intrinsic::ID ID, ArrayRef<ExprRef> Args);
+  AllocaInst *getLengthBoundedArray(ExprRef Bound, int64_t Step);
+  Value *codegenCountedFor(const ForExpr &E, ValueType VarType, int64_t Start,
+                           int64_t Step, ExprRef Bound);
+
+  Value *codegenOperator(bool IsBinary, char Op, ArrayRef<Value *> Operands);
+
+public:
+  ExprCodegen(const ExprPool &Pool, const FunctionTypes &Types,
+              BasicBlock *TailRecurse = nullptr,
+              ArrayRef<AllocaInst *> Params = None)
+      : Pool(Pool), Types(Types), TailRecurse(TailRecurse), Params(Params) {}
+
+  /// codegen - Emit E; Tail says its value is what the function returns.
+  /// 生成E；Tail表示它的值就是函数的返回值
+  Value *codegen(ExprRef E, bool Tail = false);
+};
+} // end anonymous namespace
+
+// 按节点种类分发代码生成
+Value *ExprCodegen::codegen(ExprRef E, bool Tail) {
+  switch (E.getKind()) {
+  case ExprKind::Number:
+    return codegen(Pool.getNumber(E));
+  case ExprKind::Variable:
+    return codegen(Pool.getVariable(E));
+  case ExprKind::Unary:
+    return codegen(Pool.getUnary(E));
+  case ExprKind::Binary:
+    return codegen(Pool.getBinary(E));
+  case ExprKind::Call:
+    return codegen(Pool.getCall(E), Tail);
+  case ExprKind::If:
+    return codegen(Pool.getIf(E), Tail);
+  case ExprKind::For:
+    return codegen(Pool.getFor(E), Types.Fors[E.getIndex()]);
+  case ExprKind::Var:
+    return codegen(Pool.getVar(E), Tail);
+  case ExprKind::Integer:
+    return codegen(Pool.getInteger(E));
+  case ExprKind::Index:
+    return codegen(Pool.getIndex(E));
+  }
+  llvm_unreachable("unknown expression kind");
 }
 
 // 对数字的代码生成
-Value *NumberExprAST::codegen() {
-  return ConstantFP::get(*TheContext, APFloat(Val));
+Value *ExprCodegen::codegen(const NumberExpr &E) {
+  return ConstantFP::get(*TheContext, APFloat(E.Val));
+}
+
+// 对整数的代码生成：AsInt时是int，否则和其他数字一样是double
+Value *ExprCodegen::codegen(const IntegerExpr &E, bool AsInt) {
+  if (AsInt)
+    return ConstantInt::get(Type::getInt64Ty(*TheContext), E.Val, true);
+  return ConstantFP::get(*TheContext, APFloat(double(E.Val)));
 }
 
 // 对变量生成代码
-Value *VariableExprAST::codegen() {
+Value *ExprCodegen::codegen(const VariableExpr &E) {
   // Look this variable up in the function.
   // 函数里面查找变量
-  AllocaInst *A = NamedValues[Name];
+  AllocaInst *A = NamedValues.lookup(E.Name);
   if (!A)
     return LogErrorV("Unknown variable name");
 
   // Load the value.
   // 加载值
-  return Builder->CreateLoad(A->getAllocatedType(), A, Name.c_str());
+  return Builder->CreateLoad(A->getAllocatedType(), A, Symbols.getName(E.Name));
+}
+
+/// codegenElementPtr - The address of the element E refers to, after
+/// checking the index against the length.  The lanes of a vector variable are
+/// indexed in its stack slot, which SROA turns back into lane operations.
+/// E引用的元素的地址，之前先检查下标是否小于长度。向量变量的通道在它的栈槽里按下标
+/// 访问，SROA会把它变回通道操作
+Value *ExprCodegen::codegenElementPtr(const IndexExpr &E) {
+  AllocaInst *A = NamedValues.lookup(E.Array);
+  if (!A)
+    return LogErrorV("Unknown variable name");
+  auto *VecTy = dyn_cast<FixedVectorType>(A->getAllocatedType());
+  if (!VecTy && !A->getAllocatedType()->isStructTy())
+    return LogErrorV("Type mismatch: expected an array or a vector");
+
+  Value *Index = E.Index.getKind() == ExprKind::Integer
+                     ? codegen(Pool.getInteger(E.Index), /*AsInt=*/true)
+                     : codegen(E.Index);
+  if (!Index)
+    return nullptr;
+  Type *Int64Ty = Type::getInt64Ty(*TheContext);
+  // The conversion saturates, so NaN and huge indices are caught by the
+  // check.
+  // 转换取饱和值，这样NaN和特别大的下标也会被检查出来
+  if (!(Index = convertTo(Index, Int64Ty)))
+    return nullptr;
+
+  if (VecTy) {
+    Value *Lanes = ConstantInt::get(Int64Ty, VecTy->getNumElements());
+    if (auto *C = dyn_cast<ConstantInt>(Index)) {
+      if (C->getValue().uge(VecTy->getNumElements()))
+        return LogErrorV("Lane index out of range");
+    } else if (BoundsChecks) {
+      emitBoundsCheck(Builder->CreateICmpULT(Index, Lanes, "inrange"));
+    }
+    return Builder->CreateInBoundsGEP(
+        VecTy, A, {ConstantInt::get(Int64Ty, 0), Index}, "laneptr");
+  }
+
+  Value *Array =
+      Builder->CreateLoad(A->getAllocatedType(), A, Symbols.getName(E.Array));
+  if (BoundsChecks) {
+    Value *InRange = nullptr;
+    if (E.Index.getKind() == ExprKind::Variable) {
+      AllocaInst *Var = NamedValues.lookup(Pool.getVariable(E.Index).Name);
+      for (const SafeIndex &S : SafeIndices)
+        if (S.Var == Var && S.Array == A)
+          InRange = S.InBounds;
+    }
+    // Unsigned, so a negative index fails too.
+    // 无符号比较，这样负数下标也不满足
+    if (!InRange)
+      InRange = Builder->CreateICmpULT(
+          Index, Builder->CreateExtractValue(Array, 1, "len"), "inrange");
+    emitBoundsCheck(InRange);
+  }
+  Value *Elts = Builder->CreateExtractValue(Array, 0, "elts");
+  return Builder->CreateInBoundsGEP(Type::getDoubleTy(*TheContext), Elts,
+                                    Index, "eltptr");
+}
+
+// 数组元素生成代码
+Value *ExprCodegen::codegen(const IndexExpr &E) {
+  Value *Ptr = codegenElementPtr(E);
+  if (!Ptr)
+    return nullptr;
+  return Builder->CreateLoad(Type::getDoubleTy(*TheContext), Ptr, "elt");
 }
 
 // 一元操作生成代码
-Value *UnaryExprAST::codegen() {
-  Value *OperandV = Operand->codegen();
+Value *ExprCodegen::codegen(const UnaryExpr &E) {
+  Value *OperandV = codegen(E.Operand);
   if (!OperandV)
     return nullptr;
 
-  Function *F = getFunction(std::string("unary") + Opcode);
-  if (!F)
-    return LogErrorV("Unknown unary operator");
-
-  return Builder->CreateCall(F, OperandV, "unop");
+  return codegenOperator(false, E.Opcode, OperandV);
 }
 
-Value *BinaryExprAST::codegen() {
+Value *ExprCodegen::codegen(const BinaryExpr &E) {
   // Special case '=' because we don't want to emit the LHS as an expression.
   // 特别的列子是赋值表达式，这里不会把左节点输出
-  if (Op == '=') {
+  if (E.Op == '=') {
+    // Storing to an array element evaluates to the stored double.
+    // 给数组元素赋值的值是存进去的double
+    if (E.LHS.getKind() == ExprKind::Index) {
+      Value *Val = codegen(E.RHS);
+      if (!Val || !(Val = convertTo(Val, Type::getDoubleTy(*TheContext))))
+        return nullptr;
+      Value *Ptr = codegenElementPtr(Pool.getIndex(E.LHS));
+      if (!Ptr)
+        return nullptr;
+      Builder->CreateStore(Val, Ptr);
+      return Val;
+    }
+
     // Assignment requires the LHS to be an identifier.
-    // This assume we're building without RTTI because LLVM builds that way by
-    // default.  If you build LLVM with RTTI this can be changed to a
-    // dynamic_cast for automatic error checking.
     // 赋值需要左节点是个标识符（变量）
-    // 这里假定你的LLVM在编译的时候是没有RTTI，因为LLVM编译默认就是没有RTTI
-    // 如果你编译LLVM是有RTTI，则下面要改成dynamic_cast来自动错误检查
-    VariableExprAST *LHSE = static_cast<VariableExprAST *>(LHS.get());
-    if (!LHSE)
-      return LogErrorV("destination of '=' must be a variable");
+    if (E.LHS.getKind() != ExprKind::Variable)
+      return LogErrorV("destination of '=' must be a variable or element");
     // Codegen the RHS.
     // 代码生成右节点
-    Value *Val = RHS->codegen();
+    Value *Val = codegen(E.RHS);
     if (!Val)
       return nullptr;
 
     // Look up the name.
     // 查找变量名
-    Value *Variable = NamedValues[LHSE->getName()];
+    AllocaInst *Variable = NamedValues.lookup(Pool.getVariable(E.LHS).Name);
     if (!Variable)
       return LogErrorV("Unknown variable name");
     // 保存val到变量名
+    Val = convertTo(Val, Variable->getAllocatedType());
+    if (!Val)
+      return nullptr;
     Builder->CreateStore(Val, Variable);
     return Val;
   }
 
   // 其他情况
-  Value *L = LHS->codegen();
-  Value *R = RHS->codegen();
+  // An integer literal next to an int in a builtin operator counts or indexes
+  // with it, so it is an int too.
+  // 内建操作符里和int在一起的整数字面量跟它一起计数或计算下标，所以也是int
+  bool IsBuiltin = E.Op == '+' || E.Op == '-' || E.Op == '*' || E.Op == '<';
+  Value *L, *R;
+  if (IsBuiltin && E.LHS.getKind() == ExprKind::Integer) {
+    R = codegen(E.RHS);
+    L = R ? codegen(Pool.getInteger(E.LHS), R->getType()->isIntegerTy())
+          : nullptr;
+  } else {
+    L = codegen(E.LHS);
+    R = IsBuiltin && E.RHS.getKind() == ExprKind::Integer && L
+            ? codegen(Pool.getInteger(E.RHS), L->getType()->isIntegerTy())
+            : codegen(E.RHS);
+  }
   if (!L || !R)
     return nullptr;
 
-  switch (Op) {
+  // Builtin operators work on ints when both sides are ints, lane by lane
+  // when either is a vector, and on doubles otherwise.  Int arithmetic wraps
+  // around on overflow.
+  // 两边都是int时内建操作符按int运算，有一边是向量时按通道运算，否则按double运算。
+  // int运算溢出时回绕
+  bool IsInt = L->getType()->isIntegerTy() && R->getType()->isIntegerTy();
+  if (!IsInt && IsBuiltin) {
+    Type *Ty = getType(
+        joinTypes(getValueType(L->getType()), getValueType(R->getType())));
+    if (Ty->isStructTy())
+      return LogErrorV("Type mismatch: expected a number");
+    L = convertTo(L, Ty);
+    R = convertTo(R, Ty);
+    if (!L || !R)
+      return nullptr;
+  }
+
+  switch (E.Op) {
   case '+':
-    return Builder->CreateFAdd(L, R, "addtmp");
+    return IsInt ? Builder->CreateAdd(L, R, "addtmp")
+                 : Builder->CreateFAdd(L, R, "addtmp");
   case '-':
-    return Builder->CreateFSub(L, R, "subtmp");
+    return IsInt ? Builder->CreateSub(L, R, "subtmp")
+                 : Builder->CreateFSub(L, R, "subtmp");
   case '*':
-    return Builder->CreateFMul(L, R, "multmp");
+    return IsInt ? Builder->CreateMul(L, R, "multmp")
+                 : Builder->CreateFMul(L, R, "multmp");
   case '<':
-    L = Builder->CreateFCmpULT(L, R, "cmptmp");
+    if (L->getType()->isVectorTy())
+      return Builder->CreateUIToFP(Builder->CreateFCmpULT(L, R, "cmptmp"),
+                                   L->getType(), "booltmp");
+    L = IsInt ? Builder->CreateICmpSLT(L, R, "cmptmp")
+              : Builder->CreateFCmpULT(L, R, "cmptmp");
     // Convert bool 0/1 to double 0.0 or 1.0
     // 转换0/1到0.0或1.0
     return Builder->CreateUIToFP(L, Type::getDoubleTy(*TheContext), "booltmp");
@@ -165,48 +735,252 @@ Value *BinaryExprAST::codegen() {
     break;
   }
 
-  // If it wasn't a builtin binary operator, it must be a user defined one. Emit
-  // a call to it.
-  // 如果不是内建的操作符，那肯定是用户定义的，输出一个函数调用
-  Function *F = getFunction(std::string("binary") + Op);
-  assert(F && "binary operator not found!");
-
+  // If it wasn't a builtin binary operator, it must be a user defined one.
+  // 如果不是内建的操作符，那肯定是用户定义的
   Value *Ops[] = {L, R};
-  return Builder->CreateCall(F, Ops, "binop");
+  return codegenOperator(true, E.Op, Ops);
 }
 
-Value *CallExprAST::codegen() {
+/// codegenOperator - Apply a user defined operator to already evaluated
+/// operands.  Its body is expanded right here, with the operands bound to the
+/// parameters, unless -inline-operators=false, the body is not known, or the
+/// operator is used inside its own body; then it is called instead.
+/// 把用户定义的操作符作用到已经求值的操作数上。除非-inline-operators=false、函数体
+/// 未知或者在自己的函数体里使用，操作符的函数体会直接在这里展开，参数绑定到操作数；
+/// 否则生成调用
+Value *ExprCodegen::codegenOperator(bool IsBinary, char Op,
+                                    ArrayRef<Value *> Operands) {
+  Symbol Name = getOperatorSymbol(IsBinary, Op);
+  if (const KeptBody *Kept = getOperatorExpansion(Name)) {
+    const PrototypeAST &Proto = *FunctionProtos.lookup(Name);
+    Function *TheFunction = Builder->GetInsertBlock()->getParent();
+
+    // The expansion is typed for these operands.
+    // 按这些操作数的类型推导展开代码的类型
+    SmallVector<ValueType, 2> OperandTypes;
+    for (Value *V : Operands)
+      OperandTypes.push_back(getValueType(V->getType()));
+    FunctionTypes Types =
+        inferExpansionTypes(Proto, Kept->Pool, Kept->Body, OperandTypes);
+
+    // The expansion follows the operator's own fast-math setting.
+    // 展开的代码使用操作符自己的fast-math设置
+    IRBuilderBase::FastMathFlagGuard FMFGuard(*Builder);
+    Builder->setFastMathFlags(getFastMathFlags(Proto));
+
+    // The parameters are ordinary variables of the expansion.  Operands keep
+    // their type, except that an int parameter truncates a double.
+    // 参数就是展开后的普通变量。操作数保持自己的类型，只是int参数会截断double
+    SymbolScope<AllocaInst *> OperatorScope(NamedValues);
+    for (unsigned i = 0, e = Operands.size(); i != e; ++i) {
+      Symbol Param = Proto.getArgs()[i];
+      ValueType T = Types.Args[i];
+      AllocaInst *Alloca =
+          CreateEntryBlockAlloca(TheFunction, Symbols.getName(Param), T);
+      Value *Arg = Operands[i];
+      if (Proto.getArgTypes()[i] != ValueType::Double)
+        Arg = convertTo(Arg, getType(Proto.getArgTypes()[i]));
+      if (!Arg || !(Arg = convertTo(Arg, getType(T))))
+        return nullptr;
+      Builder->CreateStore(Arg, Alloca);
+      NamedValues.bind(Param, Alloca);
+    }
+
+    ++ExpandingOperators[Name];
+    Value *V = ExprCodegen(Kept->Pool, Types).codegen(Kept->Body);
+    --ExpandingOperators[Name];
+    return V ? convertTo(V, getType(Types.Return)) : nullptr;
+  }
+
+  Function *F = getFunction(Name);
+  if (!F)
+    return LogErrorV(IsBinary ? "Unknown binary operator"
+                              : "Unknown unary operator");
+  SmallVector<Value *, 2> Args;
+  for (unsigned i = 0, e = Operands.size(); i != e; ++i) {
+    Args.push_back(convertTo(Operands[i], F->getArg(i)->getType()));
+    if (!Args.back())
+      return nullptr;
+  }
+  return Builder->CreateCall(F, Args, IsBinary ? "binop" : "unop");
+}
+
+/// A call in tail position is marked 'tail'.  A self-recursive one becomes a
+/// jump back to the top of the function with the new arguments, so it takes
+/// no stack even at -O0; the code after it is unreachable.
+/// 尾位置的调用标记为'tail'。自递归的尾调用变成带着新参数跳回函数开头，这样即使在-O0
+/// 也不占用栈；它后面的代码不可达
+Value *ExprCodegen::codegen(const CallExpr &E, bool Tail) {
+  Builtin B = getBuiltin(E.Callee, E.NumArgs);
+  if (B != Builtin::None)
+    return codegenBuiltin(B, Pool.getArgs(E));
+  if (Intrinsic::ID ID = getMathIntrinsic(E.Callee, E.NumArgs))
+    return codegenMath(ID, Pool.getArgs(E));
+
   // Look up the name in the global module table.
   // 查找函数是否存在
-  Function *CalleeF = getFunction(Callee);
+  Function *CalleeF = getFunction(E.Callee);
   if (!CalleeF)
     return LogErrorV("Unknown function referenced");
 
   // If argument mismatch error.
   // 验证下参数
+  ArrayRef<ExprRef> Args = Pool.getArgs(E);
   if (CalleeF->arg_size() != Args.size())
     return LogErrorV("Incorrect # arguments passed");
 
   std::vector<Value *> ArgsV;
   for (unsigned i = 0, e = Args.size(); i != e; ++i) {
-    ArgsV.push_back(Args[i]->codegen());
+    Value *ArgV = codegen(Args[i]);
+    if (!ArgV)
+      return nullptr;
+    ArgsV.push_back(convertTo(ArgV, CalleeF->getArg(i)->getType()));
     if (!ArgsV.back())
       return nullptr;
   }
 
-  return Builder->CreateCall(CalleeF, ArgsV, "calltmp");
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  if (Tail && TailRecurse && CalleeF == TheFunction) {
+    // Every argument is evaluated before any parameter changes.
+    // 所有参数都求值之后才修改参数变量
+    for (unsigned i = 0, e = ArgsV.size(); i != e; ++i) {
+      Value *ArgV = convertTo(ArgsV[i], Params[i]->getAllocatedType());
+      if (!ArgV)
+        return nullptr;
+      Builder->CreateStore(ArgV, Params[i]);
+    }
+    BranchInst *Br = Builder->CreateBr(TailRecurse);
+    // Imported copies were already reported where they were defined.
+    // 导入的副本在定义的地方已经报告过了
+    if (!TheFunction->hasAvailableExternallyLinkage())
+      TheContext->diagnose(
+          OptimizationRemark("tailcallelim", "tailcall-recursion", Br)
+          << "transforming tail recursion in '" << TheFunction->getName()
+          << "' into a loop");
+
+    Builder->SetInsertPoint(
+        BasicBlock::Create(*TheContext, "aftertail", TheFunction));
+    return PoisonValue::get(TheFunction->getReturnType());
+  }
+
+  CallInst *Call = Builder->CreateCall(CalleeF, ArgsV, "calltmp");
+  Call->setTailCall(Tail);
+  return Call;
+}
+
+/// codegenMath - Emit a libm call as intrinsic ID, which LLVM can constant
+/// fold and the loop vectorizer can widen.  Given vectors, it works lane by
+/// lane.
+/// 把libm调用生成为intrinsic ID，LLVM可以对它常量折叠，循环向量化器也可以把它向量化。
+/// 参数是向量时按通道计算
+Value *ExprCodegen::codegenMath(Intrinsic::ID ID, ArrayRef<ExprRef> Args) {
+  SmallVector<Value *, 3> Vals;
+  ValueType T = ValueType::Double;
+  for (ExprRef Arg : Args) {
+    Vals.push_back(codegen(Arg));
+    if (!Vals.back())
+      return nullptr;
+    T = joinTypes(T, getValueType(Vals.back()->getType()));
+  }
+
+  Type *Ty = getType(T);
+  for (Value *&V : Vals)
+    if (!(V = convertTo(V, Ty)))
+      return nullptr;
+  return Builder->CreateIntrinsic(ID, {Ty}, Vals, nullptr, "calltmp");
+}
+
+/// codegenBuiltin - Emit a call of builtin B on Args.
+/// 生成以Args为参数调用内建函数B的代码
+Value *ExprCodegen::codegenBuiltin(Builtin B, ArrayRef<ExprRef> Args) {
+  Value *V = codegen(Args[0]);
+  if (!V)
+    return nullptr;
+
+  if (B == Builtin::Vec2 || B == Builtin::Vec4 || B == Builtin::Vec8) {
+    Type *VecTy = getType(B == Builtin::Vec2   ? ValueType::Vec2
+                          : B == Builtin::Vec4 ? ValueType::Vec4
+                                               : ValueType::Vec8);
+    if (Args.size() == 1)
+      return convertTo(V, VecTy);
+    Value *Vec = UndefValue::get(VecTy);
+    for (unsigned i = 0, e = Args.size(); i != e; ++i) {
+      if (i && !(V = codegen(Args[i])))
+        return nullptr;
+      if (!(V = convertTo(V, Type::getDoubleTy(*TheContext))))
+        return nullptr;
+      Vec = Builder->CreateInsertElement(Vec, V, i, "vec");
+    }
+    return Vec;
+  }
+
+  if (B == Builtin::HSum || B == Builtin::HMin || B == Builtin::HMax) {
+    if (!V->getType()->isVectorTy())
+      return LogErrorV("Type mismatch: expected a vector");
+    if (B == Builtin::HMin)
+      return Builder->CreateFPMinReduce(V);
+    if (B == Builtin::HMax)
+      return Builder->CreateFPMaxReduce(V);
+    // The lanes may be added in any order, so the sum is a shuffle tree.
+    // 通道可以按任意顺序相加，所以求和是一棵shuffle树
+    IRBuilderBase::FastMathFlagGuard FMFGuard(*Builder);
+    FastMathFlags FMF = Builder->getFastMathFlags();
+    FMF.setAllowReassoc();
+    Builder->setFastMathFlags(FMF);
+    return Builder->CreateFAddReduce(ConstantFP::getNegativeZero(
+                                         Type::getDoubleTy(*TheContext)),
+                                     V);
+  }
+
+  Type *Int64Ty = Type::getInt64Ty(*TheContext);
+  Type *Int8PtrTy = Type::getInt8PtrTy(*TheContext);
+  switch (B) {
+  case Builtin::Array: {
+    if (!(V = convertTo(V, Int64Ty)))
+      return nullptr;
+    // A negative count makes an empty array.
+    // 负数个数得到空数组
+    Value *Zero = ConstantInt::get(Int64Ty, 0);
+    V = Builder->CreateSelect(Builder->CreateICmpSGT(V, Zero), V, Zero,
+                              "count");
+    FunctionCallee Calloc = TheModule->getOrInsertFunction(
+        "calloc", Int8PtrTy, Int64Ty, Int64Ty);
+    Value *Mem =
+        Builder->CreateCall(Calloc, {V, ConstantInt::get(Int64Ty, 8)}, "mem");
+    return makeArray(
+        Builder->CreateBitCast(Mem, Type::getDoublePtrTy(*TheContext)), V);
+  }
+  case Builtin::Len:
+    if (!(V = convertTo(V, getArrayType())))
+      return nullptr;
+    return Builder->CreateExtractValue(V, 1, "len");
+  case Builtin::Free: {
+    if (!(V = convertTo(V, getArrayType())))
+      return nullptr;
+    FunctionCallee Free = TheModule->getOrInsertFunction(
+        "free", Type::getVoidTy(*TheContext), Int8PtrTy);
+    Builder->CreateCall(
+        Free, Builder->CreateBitCast(Builder->CreateExtractValue(V, 0),
+                                     Int8PtrTy));
+    return ConstantFP::get(*TheContext, APFloat(0.0));
+  }
+  default:
+    break;
+  }
+  llvm_unreachable("not a builtin");
 }
 
 // 条件判断生成代码
-Value *IfExprAST::codegen() {
-  Value *CondV = Cond->codegen();
+Value *ExprCodegen::codegen(const IfExpr &E, bool Tail) {
+  Value *CondV = codegen(E.Cond);
   if (!CondV)
     return nullptr;
 
   // Convert condition to a bool by comparing non-equal to 0.0.
   // 通过比较不等于0.0来转换条件为一个布尔值
-  CondV = Builder->CreateFCmpONE(
-      CondV, ConstantFP::get(*TheContext, APFloat(0.0)), "ifcond");
+  CondV = isTrue(CondV, "ifcond");
+  if (!CondV)
+    return nullptr;
 
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
@@ -223,7 +997,7 @@ Value *IfExprAST::codegen() {
   // 输出then的值
   Builder->SetInsertPoint(ThenBB);
 
-  Value *ThenV = Then->codegen();
+  Value *ThenV = codegen(E.Then, Tail);
   if (!ThenV)
     return nullptr;
 
@@ -237,10 +1011,23 @@ Value *IfExprAST::codegen() {
   TheFunction->getBasicBlockList().push_back(ElseBB);
   Builder->SetInsertPoint(ElseBB);
 
-  Value *ElseV = Else->codegen();
+  Value *ElseV = codegen(E.Else, Tail);
   if (!ElseV)
     return nullptr;
 
+  // When only one side is an int, it is widened at the end of its block.
+  // 只有一边是int时，在它所在块的末尾把它转换为double
+  if (ThenV->getType() != ElseV->getType()) {
+    Type *Ty = getType(joinTypes(getValueType(ThenV->getType()),
+                                 getValueType(ElseV->getType())));
+    if (!(ElseV = convertTo(ElseV, Ty)))
+      return nullptr;
+    IRBuilderBase::InsertPointGuard Guard(*Builder);
+    Builder->SetInsertPoint(ThenBB->getTerminator());
+    if (!(ThenV = convertTo(ThenV, Ty)))
+      return nullptr;
+  }
+
   Builder->CreateBr(MergeBB);
   // Codegen of 'Else' can change the current block, update ElseBB for the PHI.
   // Else的代码生成可能改变了当前块，所以为PHI更新ElseBB
@@ -250,14 +1037,39 @@ Value *IfExprAST::codegen() {
   // 输出merge块
   TheFunction->getBasicBlockList().push_back(MergeBB);
   Builder->SetInsertPoint(MergeBB);
-  PHINode *PN = Builder->CreatePHI(Type::getDoubleTy(*TheContext), 2, "iftmp");
+  PHINode *PN = Builder->CreatePHI(ThenV->getType(), 2, "iftmp");
 
   PN->addIncoming(ThenV, ThenBB);
   PN->addIncoming(ElseV, ElseBB);
   return PN;
 }
 
-// Output for-loop as:
+// A for loop runs its body first and tests End afterwards, on the value the
+// variable had in that iteration; the variable then advances by Step.  The
+// loop is lowered in one of two ways.
+// for循环先执行循环体，然后用这次迭代时变量的值判断End，之后变量加上Step。
+// 循环有两种生成方式
+//
+// When the variable starts at an integer literal, advances by a positive
+// integer literal, is never assigned in the body, and End is "var < bound"
+// with a loop-invariant bound, the trip count is known before the loop:
+// 如果变量从整数字面量开始、按正整数字面量递增、循环体里从不赋值，并且End是
+// “var < bound”，bound不随循环变化，那么进入循环前就知道迭代次数：
+//   bound = clamp(ceil(boundexpr))        ; just boundexpr if it is an int
+//   count = bound > start ? (bound - start + step - 1) / step + 1 : 1
+// loop:
+//   k = phi [0, preheader], [k.next, loop]
+//   var = start + k * step                 ; sitofp'd if var is a double
+//   bodyexpr
+//   k.next = k + 1
+//   br k.next != count, loop, afterloop   ; !llvm.loop mustprogress
+// afterloop:
+//
+// The variable is exact while it stays below 2^53, and the bound is clamped
+// to that range; a NaN bound becomes 2^53, in place of looping forever.
+// 变量在2^53以内都是精确的，bound也被限制在这个范围内；NaN的bound变成2^53，代替死循环
+//
+// Otherwise it is output as:
 //   var = alloca double
 //   ...
 //   start = startexpr
@@ -277,21 +1089,41 @@ Value *IfExprAST::codegen() {
 //   br endcond, loop, endloop
 // outloop:
 // for循环的代码生成
-Value *ForExprAST::codegen() {
+Value *ExprCodegen::codegen(const ForExpr &E, ValueType VarType) {
+  int64_t Start, Step = 1;
+  if (getIntegralConstant(Pool, E.Start, -MaxExactInteger, MaxExactInteger,
+                          Start) &&
+      (!E.Step || getIntegralConstant(Pool, E.Step, 1, INT32_MAX, Step)) &&
+      E.End.getKind() == ExprKind::Binary &&
+      !assignsTo(Pool, E.Body, E.VarName)) {
+    const BinaryExpr &Cond = Pool.getBinary(E.End);
+    if (Cond.Op == '<' && Cond.LHS.getKind() == ExprKind::Variable &&
+        Pool.getVariable(Cond.LHS).Name == E.VarName &&
+        isLoopInvariant(Pool, Cond.RHS, E))
+      return codegenCountedFor(E, VarType, Start, Step, Cond.RHS);
+  }
+
+  if (VarType != ValueType::Int && VarType != ValueType::Double)
+    return LogErrorV("Type mismatch: a for loop variable must be a number");
+
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
   // Create an alloca for the variable in the entry block.
   // 在入口块分配一个变量存储
-  AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, VarName);
+  AllocaInst *Alloca =
+      CreateEntryBlockAlloca(TheFunction, Symbols.getName(E.VarName), VarType);
+  Type *VarTy = Alloca->getAllocatedType();
 
   // Emit the start code first, without 'variable' in scope.
   // 输出start代码先
-  Value *StartVal = Start->codegen();
+  Value *StartVal = codegen(E.Start);
   if (!StartVal)
     return nullptr;
 
   // Store the value into the alloca.
   // 保存这个值到之前的分配好的变量存储
+  if (!(StartVal = convertTo(StartVal, VarTy)))
+    return nullptr;
   Builder->CreateStore(StartVal, Alloca);
 
   // Make the new basic block for the loop header, inserting after current
@@ -308,34 +1140,35 @@ Value *ForExprAST::codegen() {
   Builder->SetInsertPoint(LoopBB);
 
   // Within the loop, the variable is defined equal to the PHI node.  If it
-  // shadows an existing variable, we have to restore it, so save it now.
-  // 保存之前的变量值，循环结束会恢复它的
-  AllocaInst *OldVal = NamedValues[VarName];
-  NamedValues[VarName] = Alloca;
+  // shadows an existing variable, the scope restores it when we are done.
+  // 循环变量放在一个新的作用域里，如果遮盖了之前的变量，离开作用域时会恢复
+  SymbolScope<AllocaInst *> LoopScope(NamedValues);
+  NamedValues.bind(E.VarName, Alloca);
 
   // Emit the body of the loop.  This, like any other expr, can change the
   // current BB.  Note that we ignore the value computed by the body, but don't
   // allow an error.
   // 输出循环体，像其他表达式，可以改变当前块。注意这里忽略循环体的返回值，并且不允许错误
-  if (!Body->codegen())
+  if (!codegen(E.Body))
     return nullptr;
 
   // Emit the step value.
   // 输出step值
   Value *StepVal = nullptr;
-  if (Step) {
-    StepVal = Step->codegen();
-    if (!StepVal)
+  if (E.Step) {
+    StepVal = codegen(E.Step);
+    if (!StepVal || !(StepVal = convertTo(StepVal, VarTy)))
       return nullptr;
   } else {
-    // If not specified, use 1.0.
-    // 不指定，就用1.0
-    StepVal = ConstantFP::get(*TheContext, APFloat(1.0));
+    // If not specified, use 1.
+    // 不指定，就用1
+    StepVal = VarType == ValueType::Int ? ConstantInt::get(VarTy, 1)
+                                        : ConstantFP::get(VarTy, 1.0);
   }
 
   // Compute the end condition.
   // 计算结束条件
-  Value *EndCond = End->codegen();
+  Value *EndCond = codegen(E.End);
   if (!EndCond)
     return nullptr;
 
@@ -343,14 +1176,17 @@ Value *ForExprAST::codegen() {
   // the body of the loop mutates the variable.
   // 加载和递增和恢复之前那个变量，这里用来处理循环体里面修改了这个变量的情况
   Value *CurVar =
-      Builder->CreateLoad(Alloca->getAllocatedType(), Alloca, VarName.c_str());
-  Value *NextVar = Builder->CreateFAdd(CurVar, StepVal, "nextvar");
+      Builder->CreateLoad(VarTy, Alloca, Symbols.getName(E.VarName));
+  Value *NextVar = VarType == ValueType::Int
+                       ? Builder->CreateAdd(CurVar, StepVal, "nextvar")
+                       : Builder->CreateFAdd(CurVar, StepVal, "nextvar");
   Builder->CreateStore(NextVar, Alloca);
 
   // Convert condition to a bool by comparing non-equal to 0.0.
   // 转换条件到一个布尔值，并比较是否不等于0.0
-  EndCond = Builder->CreateFCmpONE(
-      EndCond, ConstantFP::get(*TheContext, APFloat(0.0)), "loopcond");
+  EndCond = isTrue(EndCond, "loopcond");
+  if (!EndCond)
+    return nullptr;
 
   // Create the "after loop" block and insert it.
   // 创建循环后的块，并插入它
@@ -365,28 +1201,150 @@ Value *ForExprAST::codegen() {
   // 设置后面的代码都要插入到块AfterBB
   Builder->SetInsertPoint(AfterBB);
 
-  // Restore the unshadowed variable.
-  // 恢复之前变量的值
-  if (OldVal)
-    NamedValues[VarName] = OldVal;
-  else
-    NamedValues.erase(VarName);
-
   // for expr always returns 0.0.
   // 一直返回0.0
   return Constant::getNullValue(Type::getDoubleTy(*TheContext));
 }
 
+/// getLengthBoundedArray - If Bound is "len(a) - k" for an array variable a and
+/// an integer literal k >= Step, return a's alloca.
+/// 如果Bound是"len(a) - k"，a是数组变量，k是不小于Step的整数字面量，返回a的alloca
+AllocaInst *ExprCodegen::getLengthBoundedArray(ExprRef Bound, int64_t Step) {
+  if (Bound.getKind() != ExprKind::Binary)
+    return nullptr;
+  const BinaryExpr &Sub = Pool.getBinary(Bound);
+  int64_t K;
+  if (Sub.Op != '-' || Sub.LHS.getKind() != ExprKind::Call ||
+      !getIntegralConstant(Pool, Sub.RHS, Step, MaxExactInteger, K))
+    return nullptr;
+  const CallExpr &C = Pool.getCall(Sub.LHS);
+  ExprRef Arg = Pool.getArgs(C)[0];
+  if (getBuiltin(C.Callee, C.NumArgs) != Builtin::Len ||
+      Arg.getKind() != ExprKind::Variable)
+    return nullptr;
+  AllocaInst *Array = NamedValues.lookup(Pool.getVariable(Arg).Name);
+  if (!Array || !Array->getAllocatedType()->isStructTy())
+    return nullptr;
+  return Array;
+}
+
+/// codegenCountedFor - Emit a for loop whose trip count is computed up front,
+/// see above.
+/// 生成进入循环前就算好迭代次数的for循环，见上面
+Value *ExprCodegen::codegenCountedFor(const ForExpr &E, ValueType VarType,
+                                      int64_t Start, int64_t Step,
+                                      ExprRef Bound) {
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  Type *DoubleTy = Type::getDoubleTy(*TheContext);
+  Type *Int64Ty = Type::getInt64Ty(*TheContext);
+
+  // The bound is evaluated once, without the variable in scope.
+  // bound只求值一次，这时变量还不在作用域里
+  Value *BoundVal = codegen(Bound);
+  if (!BoundVal)
+    return nullptr;
+
+  // var < bound holds exactly for the integers below ceil(bound).
+  // 对整数来说，var < bound等价于var小于ceil(bound)
+  if (!BoundVal->getType()->isIntegerTy() && !BoundVal->getType()->isDoubleTy())
+    return LogErrorV("Type mismatch: expected a number");
+  if (BoundVal->getType()->isDoubleTy()) {
+    BoundVal = Builder->CreateUnaryIntrinsic(Intrinsic::ceil, BoundVal);
+    Value *Limit = ConstantFP::get(DoubleTy, MaxExactInteger);
+    BoundVal = Builder->CreateSelect(Builder->CreateFCmpOLT(BoundVal, Limit),
+                                     BoundVal, Limit);
+    Limit = ConstantFP::get(DoubleTy, -MaxExactInteger);
+    BoundVal = Builder->CreateSelect(Builder->CreateFCmpOGT(BoundVal, Limit),
+                                     BoundVal, Limit);
+    BoundVal = Builder->CreateFPToSI(BoundVal, Int64Ty, "bound");
+  }
+
+  // The body always runs once, then once more per step below the bound.
+  // 循环体至少执行一次，之后bound以下每一步再执行一次
+  Value *StartVal = ConstantInt::get(Int64Ty, Start);
+  Value *StepVal = ConstantInt::get(Int64Ty, Step);
+  Value *Span = Builder->CreateNSWSub(BoundVal, StartVal, "span");
+  Value *Steps = Builder->CreateSDiv(
+      Builder->CreateNSWAdd(Span, ConstantInt::get(Int64Ty, Step - 1)),
+      StepVal);
+  Value *TripCount = Builder->CreateSelect(
+      Builder->CreateICmpSGT(Span, ConstantInt::get(Int64Ty, 0)),
+      Builder->CreateNUWAdd(Steps, ConstantInt::get(Int64Ty, 1)),
+      ConstantInt::get(Int64Ty, 1), "tripcount");
+
+  AllocaInst *Alloca =
+      CreateEntryBlockAlloca(TheFunction, Symbols.getName(E.VarName), VarType);
+
+  // The last iteration is the first to reach the bound, so with a bound of
+  // len(a) - k, k >= step, the variable stays below len(a) in every iteration
+  // but perhaps the first.  Indexing a with it then needs one check only, the
+  // first iteration's 0 <= start < len(a), and that is loop invariant.
+  // 最后一次迭代是第一个达到bound的，所以bound为len(a) - k且k >= step时，除了
+  // 第一次迭代，变量总是小于len(a)。用它做a的下标只需要检查第一次迭代的
+  // 0 <= start < len(a)，这是循环不变量
+  size_t NumSafe = SafeIndices.size();
+  if (AllocaInst *Array = getLengthBoundedArray(Bound, Step);
+      Array && Start >= 0) {
+    Value *Len = Builder->CreateExtractValue(
+        Builder->CreateLoad(Array->getAllocatedType(), Array), 1, "len");
+    SafeIndices.push_back(
+        {Alloca, Array, Builder->CreateICmpSLT(StartVal, Len, "inbounds")});
+  }
+
+  BasicBlock *PreheaderBB = Builder->GetInsertBlock();
+  BasicBlock *LoopBB = BasicBlock::Create(*TheContext, "loop", TheFunction);
+  Builder->CreateBr(LoopBB);
+  Builder->SetInsertPoint(LoopBB);
+
+  PHINode *Index = Builder->CreatePHI(Int64Ty, 2, "index");
+  Index->addIncoming(ConstantInt::get(Int64Ty, 0), PreheaderBB);
+  Value *IntVar =
+      Builder->CreateNSWAdd(StartVal, Builder->CreateNSWMul(Index, StepVal));
+  Builder->CreateStore(convertTo(IntVar, Alloca->getAllocatedType()), Alloca);
+
+  SymbolScope<AllocaInst *> LoopScope(NamedValues);
+  NamedValues.bind(E.VarName, Alloca);
+
+  Value *BodyVal = codegen(E.Body);
+  SafeIndices.resize(NumSafe);
+  if (!BodyVal)
+    return nullptr;
+
+  Value *NextIndex = Builder->CreateNUWAdd(
+      Index, ConstantInt::get(Int64Ty, 1), "index.next");
+  Index->addIncoming(NextIndex, Builder->GetInsertBlock());
+
+  BasicBlock *AfterBB =
+      BasicBlock::Create(*TheContext, "afterloop", TheFunction);
+  setMustProgress(Builder->CreateCondBr(
+      Builder->CreateICmpNE(NextIndex, TripCount, "loopcond"), LoopBB,
+      AfterBB));
+  Builder->SetInsertPoint(AfterBB);
+
+  // for expr always returns 0.0.
+  // 一直返回0.0
+  return Constant::getNullValue(DoubleTy);
+}
+
 // 变量定义生成代码
-Value *VarExprAST::codegen() {
-  std::vector<AllocaInst *> OldBindings;
+Value *ExprCodegen::codegen(const VarExpr &E, bool Tail) {
+  ArrayRef<VarBinding> VarNames = Pool.getBindings(E);
+
+  // The new variables are popped again when this scope ends.
+  // 离开这个作用域时，新定义的变量会被弹出
+  SymbolScope<AllocaInst *> VarScope(NamedValues);
 
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
+  // Stack arrays are popped again when the body is done, so one declared in
+  // a loop does not grow the stack.
+  // 栈上数组在函数体结束后弹出，这样在循环里定义的数组不会让栈一直增长
+  Value *SavedStack = nullptr;
+
   // Register all variables and emit their initializer.
   for (unsigned i = 0, e = VarNames.size(); i != e; ++i) {
-    const std::string &VarName = VarNames[i].first;
-    ExprAST *Init = VarNames[i].second.get();
+    Symbol VarName = VarNames[i].Name;
+    ExprRef Init = VarNames[i].Init;
 
     // Emit the initializer before adding the variable to scope, this prevents
     // the initializer from referencing the variable itself, and permits stuff
@@ -394,125 +1352,399 @@ Value *VarExprAST::codegen() {
     //  var a = 1 in
     //    var a = a in ...   # refers to outer 'a'.
     // 在把变量放入作用域，先输出初始化，这样可以阻止引用自己，和实现像上面的东西
+    ValueType VarType = Types.Bindings[E.FirstBinding + i];
     Value *InitVal;
-    if (Init) {
-      InitVal = Init->codegen();
+    if (VarNames[i].IsArray) {
+      Value *Size = codegen(Init);
+      Type *Int64Ty = Type::getInt64Ty(*TheContext);
+      if (!Size || !(Size = convertTo(Size, Int64Ty)))
+        return nullptr;
+      Value *Zero = ConstantInt::get(Int64Ty, 0);
+      Size = Builder->CreateSelect(Builder->CreateICmpSGT(Size, Zero), Size,
+                                   Zero, "count");
+      if (!SavedStack)
+        SavedStack = Builder->CreateIntrinsic(Intrinsic::stacksave, {}, {});
+      Type *DoubleTy = Type::getDoubleTy(*TheContext);
+      Value *Elts = Builder->CreateAlloca(DoubleTy, Size,
+                                          Symbols.getName(VarName) + ".elts");
+      Builder->CreateMemSet(
+          Elts, ConstantInt::get(Type::getInt8Ty(*TheContext), 0),
+          Builder->CreateNUWMul(Size, ConstantInt::get(Int64Ty, 8)),
+          MaybeAlign(8));
+      InitVal = convertTo(makeArray(Elts, Size), getType(VarType));
       if (!InitVal)
         return nullptr;
-    } else { // If not specified, use 0.0. 默认为0.0
-      InitVal = ConstantFP::get(*TheContext, APFloat(0.0));
+    } else if (Init) {
+      InitVal = codegen(Init);
+      if (!InitVal || !(InitVal = convertTo(InitVal, getType(VarType))))
+        return nullptr;
+    } else { // If not specified, use 0. 默认为0
+      InitVal = Constant::getNullValue(getType(VarType));
     }
 
-    AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, VarName);
+    AllocaInst *Alloca =
+        CreateEntryBlockAlloca(TheFunction, Symbols.getName(VarName), VarType);
     Builder->CreateStore(InitVal, Alloca);
 
-    // Remember the old variable binding so that we can restore the binding when
-    // we unrecurse.
-    // 保存之前的变量绑定，方便递归回来的时候恢复
-    OldBindings.push_back(NamedValues[VarName]);
-
     // Remember this binding.
     // 记住这个变量绑定
-    NamedValues[VarName] = Alloca;
+    NamedValues.bind(VarName, Alloca);
   }
 
   // Codegen the body, now that all vars are in scope.
   // 输出内容，这样现在所有变量都在作用域
-  Value *BodyVal = Body->codegen();
+  // Stack arrays must be released after the body, so it is not in tail
+  // position then; a call there may also be given pointers into them.
+  // 函数体之后要释放栈上数组，所以这时函数体不在尾位置；而且那里的调用可能拿到指向它们的指针
+  Value *BodyVal = codegen(E.Body, Tail && !SavedStack);
   if (!BodyVal)
     return nullptr;
-
-  // Pop all our variables from scope.
-  // 退出作用域时，恢复之前的变量
-  for (unsigned i = 0, e = VarNames.size(); i != e; ++i)
-    NamedValues[VarNames[i].first] = OldBindings[i];
+  if (SavedStack)
+    Builder->CreateIntrinsic(Intrinsic::stackrestore, {}, {SavedStack});
 
   // Return the body computation.
   // 返回内容的值
   return BodyVal;
 }
 
-// 对原型函数输出代码
-Function *PrototypeAST::codegen() {
-  // Make the function type:  double(double,double) etc.
-  // 创建函数类型：
-  std::vector<Type *> Doubles(Args.size(), Type::getDoubleTy(*TheContext));
-  FunctionType *FT =
-      FunctionType::get(Type::getDoubleTy(*TheContext), Doubles, false);
-
-  Function *F =
-      Function::Create(FT, Function::ExternalLinkage, Name, TheModule.get());
-
-  // Set names for all arguments.
-  // 给每个参数设置名字
-  unsigned Idx = 0;
-  for (auto &Arg : F->args())
-    Arg.setName(Args[Idx++]);
-
-  return F;
-}
-
-// 给函数生成代码
-Function *FunctionAST::codegen() {
-  // Transfer ownership of the prototype to the FunctionProtos map, but keep a
-  // reference to it for use below.
-  // 把原型函数放进FunctionProtos，保留一个引用给下面用
-  auto &P = *Proto;
-  FunctionProtos[Proto->getName()] = std::move(Proto);
-  Function *TheFunction = getFunction(P.getName());
-  if (!TheFunction)
-    return nullptr;
-
-  // If this is an operator, install it.
-  // 如果是一个操作符，安装它
-  if (P.isBinaryOp())
-    BinopPrecedence[P.getOperatorName()] = P.getBinaryPrecedence();
-
+/// emitFunctionBody - Emit Body as the definition of the empty function F,
+/// whose arguments are named by Proto, with the types inference found.
+/// 把Body生成为空函数F的定义，F的参数名来自Proto，类型使用类型推导的结果
+static bool emitFunctionBody(Function *F, const PrototypeAST &Proto,
+                             const ExprPool &Pool, ExprRef Body,
+                             const FunctionTypes &Types) {
   // Create a new basic block to start insertion into.
   // 创建一个块，并开始插入它
-  BasicBlock *BB = BasicBlock::Create(*TheContext, "entry", TheFunction);
+  BasicBlock *BB = BasicBlock::Create(*TheContext, "entry", F);
   Builder->SetInsertPoint(BB);
 
-  // Record the function arguments in the NamedValues map.
-  // 情况变量表
-  NamedValues.clear();
-  for (auto &Arg : TheFunction->args()) {
-    // Create an alloca for this variable.
-    // 为每个参数变量创建存储
-    AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, Arg.getName());
+  // Fast-math code gets the flags on every instruction, and the function
+  // attributes tell the backend the same, e.g. to form FMAs.
+  // fast-math的代码在每条指令上带标志，函数属性也告诉后端同样的事，比如生成FMA
+  FastMathFlags FMF = getFastMathFlags(Proto);
+  Builder->setFastMathFlags(FMF);
+  if (FMF.isFast())
+    for (const char *Attr :
+         {"unsafe-fp-math", "no-infs-fp-math", "no-nans-fp-math",
+          "no-signed-zeros-fp-math", "approx-func-fp-math"})
+      F->addFnAttr(Attr, "true");
+
+  // Record the function arguments in the NamedValues map, in a scope of
+  // their own that ends with the function.
+  // 把参数记录到变量表，放在一个函数结束时就结束的作用域里
+  SymbolScope<AllocaInst *> ArgScope(NamedValues);
+  SmallVector<AllocaInst *, 4> Params;
+  unsigned Idx = 0;
+  for (auto &Arg : F->args()) {
+    // Create an alloca for this variable; an int argument assigned a double
+    // is kept as a double.
+    // 为每个参数变量创建存储；被赋值为double的int参数用double存储
+    ValueType T = Types.Args[Idx];
+    AllocaInst *Alloca = CreateEntryBlockAlloca(F, Arg.getName(), T);
 
     // Store the initial value into the alloca.
     // 保存初始化值
-    Builder->CreateStore(&Arg, Alloca);
+    Value *Init = convertTo(&Arg, getType(T));
+    if (!Init)
+      return false;
+    Builder->CreateStore(Init, Alloca);
 
     // Add arguments to variable symbol table.
     // 把参数加入到变量表
-    NamedValues[std::string(Arg.getName())] = Alloca;
+    NamedValues.bind(Proto.getArgs()[Idx++], Alloca);
+    Params.push_back(Alloca);
   }
 
+  // Self-recursive tail calls come back here with new arguments.
+  // 自递归的尾调用带着新参数回到这里
+  BasicBlock *TailRecurse = BasicBlock::Create(*TheContext, "tailrecurse", F);
+  Builder->CreateBr(TailRecurse);
+  Builder->SetInsertPoint(TailRecurse);
+
   // 生成函数体代码
-  if (Value *RetVal = Body->codegen()) {
+  Value *RetVal = ExprCodegen(Pool, Types, TailRecurse, Params)
+                      .codegen(Body, /*Tail=*/true);
+  if (RetVal && (RetVal = convertTo(RetVal, F->getReturnType()))) {
     // Finish off the function.
     // 创建返回值
     Builder->CreateRet(RetVal);
 
     // Validate the generated code, checking for consistency.
     // 验证生成的代码，验证下一致性
-    verifyFunction(*TheFunction);
+    verifyFunction(*F);
+    return true;
+  }
+  return false;
+}
+
+/// emitImports - Give every pending import an available_externally copy of
+/// its body.  The inliner can inline such a copy, but it is never compiled:
+/// other calls still go to the JIT'd original.  Copies may call further
+/// small functions, which are imported in turn.
+/// 给每个待导入的函数输出一份available_externally的函数体副本。内联器可以内联
+/// 这份副本，但它不会被编译，没有内联的调用仍然调用JIT里的原函数。副本里调用的其他
+/// 小函数也会依次导入
+static void emitImports() {
+  while (!PendingImports.empty()) {
+    Symbol Name = PendingImports.back();
+    PendingImports.pop_back();
+
+    Function *F = moduleFunction(Name);
+    if (!F || !F->empty())
+      continue;
+    const KeptBody &Import = *KeptBodies.lookup(Name);
+    F->setLinkage(GlobalValue::AvailableExternallyLinkage);
+    if (!emitFunctionBody(F, *FunctionProtos.lookup(Name), Import.Pool,
+                          Import.Body, Import.Types))
+      F->deleteBody();
+  }
+}
+
+/// getFunctionType - The LLVM signature for Proto: double(double,i64) etc.
+/// Proto对应的LLVM函数类型：double(double,i64)等
+static FunctionType *getFunctionType(const PrototypeAST &Proto) {
+  std::vector<Type *> ArgTys;
+  for (ValueType T : Proto.getArgTypes())
+    ArgTys.push_back(getType(T));
+  return FunctionType::get(getType(Proto.getReturnType()), ArgTys, false);
+}
+
+/// addEffectAttributes - Tell LLVM what calls to F may do, so GVN can merge
+/// calls with the same arguments to a pure F and LICM can hoist them.
+/// 告诉LLVM调用F可能做什么，这样GVN可以合并参数相同的纯函数调用，LICM可以把它们提到循环外
+static void addEffectAttributes(Function *F, const FunctionEffects &E) {
+  if (E.Memory == FunctionEffects::NoMemory)
+    F->setDoesNotAccessMemory();
+  else if (E.Memory == FunctionEffects::ReadsMemory)
+    F->setOnlyReadsMemory();
+  if (E.NoUnwind)
+    F->setDoesNotThrow();
+  if (E.WillReturn)
+    F->addFnAttr(Attribute::WillReturn);
+  if (E.NoRecurse)
+    F->setDoesNotRecurse();
+}
+
+// 对原型函数输出代码
+Function *PrototypeAST::codegen() {
+  // Make the function type:  double(double,i64) etc.
+  // 创建函数类型：
+  FunctionType *FT = getFunctionType(*this);
+
+  Function *F = Function::Create(FT, Function::ExternalLinkage,
+                                 Symbols.getName(Name), TheModule.get());
+  moduleFunction(Name) = F;
+  addEffectAttributes(F, Effects);
+
+  // Set names for all arguments.
+  // 给每个参数设置名字
+  unsigned Idx = 0;
+  for (auto &Arg : F->args())
+    Arg.setName(Symbols.getName(Args[Idx++]));
+
+  return F;
+}
 
-    // Run the optimizer on the function.
-    // 运行优化器优化下这个函数
-    TheFPM->run(*TheFunction);
+/// isMemoizable - Whether the results of Proto, a pure function, can be
+/// cached: its arguments and result are numbers, keyed by their bits.
+/// 纯函数Proto的结果能否缓存：参数和结果都是数字，按二进制位作为键
+static bool isMemoizable(const PrototypeAST &Proto) {
+  auto IsNumber = [](ValueType T) {
+    return T == ValueType::Double || T == ValueType::Int;
+  };
+  return llvm::all_of(Proto.getArgTypes(), IsNumber) &&
+         IsNumber(Proto.getReturnType());
+}
 
+// A memo function F is a wrapper around its body, compiled as the internal
+// function Body, with a table of results in a global of the module:
+// memo函数F包装它的函数体（生成为内部函数Body），结果表是模块里的一个全局变量：
+//   @F.memo = internal global [Entries * (NumArgs + 2) x i64] zeroinitializer
+//
+// An entry is a nonzero flag, the bits of the arguments, the bits of the
+// result.  Lookups probe a few entries from the hash of the arguments; a
+// miss computes the result and stores it in the last entry probed, which
+// evicts whatever was there.  Recursive calls go through F, so each result
+// is computed once while it stays in the table.
+// 每项是非零的标志、参数的二进制位、结果的二进制位。查找从参数的哈希开始探测几项；
+// 没找到时计算结果，存进最后探测的那一项，替换掉原来的内容。递归调用经过F，所以每个
+// 结果只要还在表里就只计算一次
+//
+// The table is private to the module, so other modules may still treat F
+// as pure.
+// 结果表是模块私有的，所以其他模块仍然可以把F当作纯函数
+static void emitMemoWrapper(Function *F, Function *Body) {
+  const unsigned Probes = 8;
+  LLVMContext &C = *TheContext;
+  Type *Int64Ty = Type::getInt64Ty(C);
+  unsigned NumKeys = F->arg_size(), Width = NumKeys + 2;
+  uint64_t Entries = PowerOf2Ceil(std::max(MemoEntries.getValue(), 1u));
+  ArrayType *TableTy = ArrayType::get(Int64Ty, Entries * Width);
+  auto *Table = new GlobalVariable(*TheModule, TableTy, false,
+                                   GlobalValue::InternalLinkage,
+                                   Constant::getNullValue(TableTy),
+                                   F->getName() + ".memo");
+  auto Slot = [&](Value *Base, unsigned Field) {
+    Value *Idx = Builder->CreateAdd(Base, ConstantInt::get(Int64Ty, Field));
+    return Builder->CreateInBoundsGEP(
+        TableTy, Table, {ConstantInt::get(Int64Ty, 0), Idx});
+  };
+
+  BasicBlock *Entry = BasicBlock::Create(C, "entry", F);
+  Builder->SetInsertPoint(Entry);
+  SmallVector<Value *, 4> Args, Keys;
+  Value *Hash = ConstantInt::get(Int64Ty, NumKeys);
+  for (Argument &Arg : F->args()) {
+    Args.push_back(&Arg);
+    Keys.push_back(Builder->CreateBitCast(&Arg, Int64Ty));
+    // Doubles differ in their high bits, which the multiply only carries
+    // upwards, so fold them down first.
+    // double的差别在高位，乘法只会把差别往高位传，所以先把高位折叠下来
+    Value *Key = Builder->CreateXor(Keys.back(),
+                                    Builder->CreateLShr(Keys.back(), 32));
+    Hash = Builder->CreateMul(Builder->CreateXor(Hash, Key),
+                              ConstantInt::get(Int64Ty, 0x9e3779b97f4a7c15));
+    Hash = Builder->CreateXor(Hash, Builder->CreateLShr(Hash, 32));
+  }
+
+  BasicBlock *Probe = BasicBlock::Create(C, "probe", F);
+  BasicBlock *Compare = BasicBlock::Create(C, "compare", F);
+  BasicBlock *Next = BasicBlock::Create(C, "next", F);
+  BasicBlock *Hit = BasicBlock::Create(C, "hit", F);
+  BasicBlock *Miss = BasicBlock::Create(C, "miss", F);
+  Builder->CreateBr(Probe);
+
+  Builder->SetInsertPoint(Probe);
+  PHINode *I = Builder->CreatePHI(Int64Ty, 2, "i");
+  I->addIncoming(ConstantInt::get(Int64Ty, 0), Entry);
+  Value *Index = Builder->CreateAnd(Builder->CreateAdd(Hash, I),
+                                    ConstantInt::get(Int64Ty, Entries - 1));
+  Value *Base = Builder->CreateMul(Index, ConstantInt::get(Int64Ty, Width));
+  Value *Flag = Builder->CreateLoad(Int64Ty, Slot(Base, 0), "flag");
+  Builder->CreateCondBr(Builder->CreateICmpEQ(Flag, Builder->getInt64(0)),
+                        Miss, Compare);
+
+  Builder->SetInsertPoint(Compare);
+  Value *Match = Builder->getTrue();
+  for (unsigned k = 0; k != NumKeys; ++k)
+    Match = Builder->CreateAnd(
+        Match, Builder->CreateICmpEQ(
+                   Builder->CreateLoad(Int64Ty, Slot(Base, k + 1)), Keys[k]));
+  Builder->CreateCondBr(Match, Hit, Next);
+
+  Builder->SetInsertPoint(Next);
+  Value *INext = Builder->CreateAdd(I, Builder->getInt64(1));
+  I->addIncoming(INext, Next);
+  Builder->CreateCondBr(Builder->CreateICmpEQ(INext, Builder->getInt64(Probes)),
+                        Miss, Probe);
+
+  Builder->SetInsertPoint(Hit);
+  Value *Cached = Builder->CreateLoad(Int64Ty, Slot(Base, NumKeys + 1));
+  Builder->CreateRet(Builder->CreateBitCast(Cached, F->getReturnType()));
+
+  Builder->SetInsertPoint(Miss);
+  Value *Result = Builder->CreateCall(Body, Args, "result");
+  Builder->CreateStore(Builder->getInt64(1), Slot(Base, 0));
+  for (unsigned k = 0; k != NumKeys; ++k)
+    Builder->CreateStore(Keys[k], Slot(Base, k + 1));
+  Builder->CreateStore(Builder->CreateBitCast(Result, Int64Ty),
+                       Slot(Base, NumKeys + 1));
+  Builder->CreateRet(Result);
+
+  verifyFunction(*F);
+}
+
+// 给函数生成代码
+Function *FunctionAST::codegen() {
+  auto &P = *Proto;
+  if (getBuiltin(P.getName(), P.getArgs().size()) != Builtin::None)
+    return (Function *)LogErrorV("Function name is taken by a builtin.");
+
+  // A definition following an extern takes its signature, which callers may
+  // already be compiled against: its parameters and a double result.
+  // extern之后的定义采用extern的签名，调用者可能已经按它编译了：它的参数和double结果
+  auto &Declared = FunctionProtos.lookup(P.getName());
+  bool IsDeclared = Declared && Declared->isExtern();
+  if (IsDeclared && Declared->getArgTypes() != P.getArgTypes())
+    return (Function *)LogErrorV("Function redefined with another type.");
+
+  // The signature needs the return type, so infer the types first.
+  // 函数签名需要返回类型，所以先做类型推导
+  FunctionTypes Types = inferTypes(
+      P, Pool, Body, IsDeclared ? ValueType::Double : ValueType::Int);
+  if (IsDeclared && Types.Return != ValueType::Double)
+    return (Function *)LogErrorV("Function redefined with another type.");
+  P.setReturnType(Types.Return);
+  FunctionEffects Effects = inferEffects(P, Pool, Body);
+  if (P.isMemo()) {
+    if (Effects.Memory != FunctionEffects::NoMemory)
+      return (Function *)LogErrorV("Only pure functions can be memoized");
+    if (!isMemoizable(P))
+      return (Function *)LogErrorV(
+          "Memoized functions must take and return numbers");
+  } else {
+    // The wrapper of a memo function writes its table, so only other modules
+    // see its effects, once it is done.
+    // memo函数的包装会写结果表，所以只有完成后的其他模块才看到它的效果
+    P.setEffects(Effects);
+  }
+
+  // A batch can hold several definitions in one module, so catch a second
+  // body for the same name here.
+  // 一个模块里可能有好几个定义，所以在这里检查同名函数被重复定义
+  Function *TheFunction = moduleFunction(P.getName());
+  if (TheFunction && !TheFunction->empty())
+    return (Function *)LogErrorV("Function cannot be redefined.");
+  if (TheFunction && TheFunction->getFunctionType() != getFunctionType(P))
+    return (Function *)LogErrorV("Function redefined with another type.");
+
+  // Only now transfer ownership of the prototype to the FunctionProtos map,
+  // but keep a reference to it for use below, and the one it replaces in case
+  // the body fails.
+  // 检查通过后才把原型函数放进FunctionProtos，保留一个引用给下面用，并保留被替换的原型，
+  // 以防函数体出错
+  std::unique_ptr<PrototypeAST> Previous =
+      std::move(FunctionProtos[P.getName()]);
+  FunctionProtos[P.getName()] = std::move(Proto);
+  if (!TheFunction)
+    TheFunction = P.codegen();
+  // An extern declared earlier in the batch knew nothing of the body.
+  // 批次里先前的extern声明不知道函数体
+  addEffectAttributes(TheFunction, P.getEffects());
+
+  Function *BodyFunction = TheFunction;
+  if (P.isMemo())
+    BodyFunction = Function::Create(TheFunction->getFunctionType(),
+                                    GlobalValue::InternalLinkage,
+                                    TheFunction->getName() + ".body",
+                                    TheModule.get());
+
+  if (emitFunctionBody(BodyFunction, P, Pool, Body, Types)) {
+    // Keep operators and small bodies around for the code that will use them;
+    // a copy of a memo body would skip its table.
+    // 保留操作符和小函数的函数体，给之后使用它们的代码；memo函数体的副本会绕过结果表
+    if (!P.isMemo() &&
+        (P.isUnaryOp() || P.isBinaryOp() || Pool.size() <= ImportLimit))
+      KeptBodies[P.getName()].reset(new KeptBody{Pool, Body, Types});
+    else
+      KeptBodies[P.getName()].reset();
+    if (P.isMemo()) {
+      emitMemoWrapper(TheFunction, BodyFunction);
+      PendingEffects.push_back({P.getName(), Effects});
+    }
+    emitImports();
     return TheFunction;
   }
 
   // Error reading body, remove function.
   // 读取函数体出错了，移除函数
+  PendingImports.clear();
+  if (BodyFunction != TheFunction)
+    BodyFunction->eraseFromParent();
   TheFunction->eraseFromParent();
-
-  // 移除操作符
-  if (P.isBinaryOp())
-    BinopPrecedence.erase(P.getOperatorName());
+  moduleFunction(P.getName()) = nullptr;
+  // Callers keep the signature of what the JIT still has.
+  // 调用者继续使用JIT里仍然存在的函数的签名
+  FunctionProtos[P.getName()] = std::move(Previous);
   return nullptr;
-}
\ No newline at end of file
+}
@@ -2,6 +2,8 @@
 #define CODEGEN_H
 
 #include "KaleidoscopeJIT.h" 
+#include "symtab.h"
+#include "types.h"
 
 using namespace llvm;
 using namespace llvm::orc;
@@ -9,10 +11,51 @@ using namespace llvm::orc;
 extern std::unique_ptr<LLVMContext> TheContext;
 extern std::unique_ptr<Module> TheModule;
 extern std::unique_ptr<IRBuilder<>> Builder;
-extern std::unique_ptr<legacy::FunctionPassManager> TheFPM;
 extern std::unique_ptr<KaleidoscopeJIT> TheJIT;
-extern std::map<std::string, std::unique_ptr<PrototypeAST>> FunctionProtos;
+extern SymbolTable<std::unique_ptr<PrototypeAST>> FunctionProtos;
 extern ExitOnError ExitOnErr;
+extern unsigned ModuleGeneration; // Bumped for every new module. 每个新模块加一
+
+/// KeptBody - The body of a function definition, kept after its module went
+/// to the JIT so later code can import or expand it.
+/// 函数定义的函数体，在它的模块交给JIT之后仍然保留，之后的代码可以导入或展开它
+struct KeptBody {
+  ExprPool Pool;
+  ExprRef Body;
+  FunctionTypes Types;
+};
+
+/// ExpandingOperators - Operators whose body is being expanded (or typed for
+/// an expansion) right now; a recursive use inside the body is a real call.
+/// 正在展开（或为展开做类型推导）的操作符，函数体里递归使用时是真正的调用
+extern SymbolTable<unsigned> ExpandingOperators;
+
+/// getOperatorExpansion - The body a use of operator Name expands to, or null
+/// when the use is a call.
+/// 使用操作符Name时展开的函数体，如果是函数调用则返回空
+const KeptBody *getOperatorExpansion(Symbol Name);
+
+/// getMathIntrinsic - The LLVM intrinsic a call to Callee with NumArgs
+/// arguments maps to, when Callee is a libm function such as sin or pow
+/// declared extern with double parameters; not_intrinsic otherwise.
+/// 如果Callee是用extern声明、参数都是double的libm函数（比如sin或pow），返回以NumArgs
+/// 个参数调用它时对应的LLVM intrinsic，否则返回not_intrinsic
+Intrinsic::ID getMathIntrinsic(Symbol Callee, size_t NumArgs);
+
+/// getOperatorSymbol - Return the symbol of the function implementing a user
+/// defined operator, e.g. "binary:" or "unary!".
+/// 返回用户定义操作符对应函数的符号，比如"binary:"或"unary!"
+Symbol getOperatorSymbol(bool IsBinary, char Op);
+
+/// getFunction - The function Name in TheModule, declared from its prototype
+/// in FunctionProtos if need be; null when Name is unknown.
+/// TheModule里的函数Name，需要时按FunctionProtos里的原型声明它；Name未知时返回空
+Function *getFunction(Symbol Name);
+
+/// publishEffects - Let the memo functions of the module just handed off
+/// show the effects of their bodies to the code generated from now on.
+/// 让刚交出去的模块里的memo函数对之后生成的代码显示它们函数体的效果
+void publishEffects();
 
 
 #endif // CODEGEN_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "KaleidoscopeJIT.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -8,16 +9,14 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
-#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Scalar/GVN.h"
-#include "llvm/Transforms/Utils.h"
 #include <algorithm>
 #include <cassert>
 #include <cctype>
@@ -31,11 +30,94 @@
 #include <vector>
 #include "ast.h"
 #include "codegen.h"
+#include "interpreter.h"
 #include "parser.h"
 #include "lexer.h"
+#include "options.h"
+#include "optimizer.h"
+#include "tiering.h"
 
+cl::OptionCategory KaleidoscopeCategory("Kaleidoscope options");
 
+static cl::list<std::string> InputFilenames(cl::Positional,
+                                            cl::desc("<input .ks files>"),
+                                            cl::cat(KaleidoscopeCategory));
 
+static cl::opt<unsigned>
+    ParseJobs("j",
+              cl::desc("Parse input files concurrently on N threads "
+                       "(0 = all cores, default 1)"),
+              cl::init(1), cl::Prefix, cl::cat(KaleidoscopeCategory));
+
+static cl::opt<unsigned> BatchSize(
+    "batch",
+    cl::desc("Compile up to N consecutive definitions as one module; a "
+             "top-level expression always flushes the batch (default 1)"),
+    cl::init(1), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<unsigned> CompileThreads(
+    "compile-threads",
+    cl::desc("Optimize and compile definitions on N background threads while "
+             "parsing goes on; 0 compiles them in the foreground (default 0)"),
+    cl::init(0), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<std::string> ObjectCacheDir(
+    "object-cache",
+    cl::desc("Keep compiled objects in <dir> and load them in later runs "
+             "instead of compiling the same code again"),
+    cl::value_desc("dir"), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<unsigned> ObjectCacheSize(
+    "object-cache-size",
+    cl::desc("Delete the least recently used objects once the object cache "
+             "takes more than N MB (default 256)"),
+    cl::init(256), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> ObjectCacheStats(
+    "object-cache-stats",
+    cl::desc("Print the object cache's hits, misses and evictions on exit"),
+    cl::init(false), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> HostCPU(
+    "host-cpu",
+    cl::desc("Generate code for the host CPU and its features instead of a "
+             "generic CPU (default true)"),
+    cl::init(true), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> Interpret(
+    "interpret",
+    cl::desc("Run top-level expressions that only use numbers on a bytecode "
+             "interpreter instead of compiling them (default true)"),
+    cl::init(true), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> Lazy(
+    "lazy",
+    cl::desc("Compile the machine code of each defined function only when it "
+             "is first called (default false)"),
+    cl::init(false), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool> Tiered(
+    "tiered",
+    cl::desc("Install definitions unoptimized first and recompile the hot "
+             "ones at the -O level in the background (default false)"),
+    cl::init(false), cl::cat(KaleidoscopeCategory));
+
+/// Prompt - Whether to print "ready> ", only done when reading stdin.
+/// 是否打印提示符，只有读取标准输入时才打印
+static bool Prompt = true;
+
+/// TheOptimizer - Runs the -O pipeline over each module before the JIT gets it.
+/// 在模块交给JIT之前运行-O优化流水线
+static std::unique_ptr<Optimizer> TheOptimizer;
+
+/// OptimizeInJIT - Whether the JIT runs the -O pipeline over modules when it
+/// compiles them, rather than the driver before handing them over.
+/// JIT是否在编译模块时运行-O优化流水线，而不是由驱动在交给JIT之前运行
+static bool OptimizeInJIT = false;
+
+/// TheTieredCompiler - Takes the definitions instead of the JIT with -tiered.
+/// 使用-tiered时代替JIT接收函数定义
+static std::unique_ptr<TieredCompiler> TheTieredCompiler;
 
 
 
@@ -45,164 +127,528 @@
 // 顶层解析和JIT 驱动
 //===----------------------------------------------------------------------===//
 
-// 初始化一个模块和优化
-void InitializeModuleAndPassManager() {
+// 初始化一个模块
+void InitializeModule() {
   // Open a new module.
   // 打开一个新模块
   TheContext = std::make_unique<LLVMContext>();
   TheModule = std::make_unique<Module>("my cool jit", *TheContext);
   TheModule->setDataLayout(TheJIT->getDataLayout());
+  ++ModuleGeneration;
+  publishEffects();
 
   // Create a new builder for the module.
   // 创建一个代码生成构造器给这个模块
   Builder = std::make_unique<IRBuilder<>>(*TheContext);
+}
 
-  // Create a new pass manager attached to it.
-  // 创建一个优化器
-  TheFPM = std::make_unique<legacy::FunctionPassManager>(TheModule.get());
+/// PendingDefinitions - Functions defined in TheModule that the JIT has not
+/// seen yet.
+/// TheModule里已经定义、但还没交给JIT的函数
+static std::vector<Function *> PendingDefinitions;
 
-  // Promote allocas to registers.
-  // 提升变量存储（栈）到寄存器 
-  TheFPM->add(createPromoteMemoryToRegisterPass());
-  // Do simple "peephole" optimizations and bit-twiddling optzns.
-  TheFPM->add(createInstructionCombiningPass());
-  // Reassociate expressions.
-  TheFPM->add(createReassociatePass());
-  // Eliminate Common SubExpressions.
-  TheFPM->add(createGVNPass());
-  // Simplify the control flow graph (deleting unreachable blocks, etc).
-  TheFPM->add(createCFGSimplificationPass());
+/// DefinedNames - Functions whose definition was handed to the JIT.
+/// 定义已经交给JIT的函数
+static StringSet<> DefinedNames;
 
-  TheFPM->doInitialization();
+/// canLinkNow - Whether every function M calls is already defined or found in
+/// the process, so compiling M ahead of its first use cannot fail on a
+/// definition that is still to come.
+/// M调用的每个函数是否都已经定义或者能在进程里找到，这样在第一次使用之前编译M不会
+/// 因为还没读到的定义而失败
+static bool canLinkNow(const Module &M) {
+  for (const Function &F : M)
+    if (F.isDeclaration() && !F.isIntrinsic() &&
+        !DefinedNames.count(F.getName()) &&
+        !sys::DynamicLibrary::SearchForAddressOfSymbol(F.getName().str()))
+      return false;
+  return true;
 }
 
-// 解析和代码生成函数定义
-void HandleDefinition() {
-  if (auto FnAST = ParseDefinition()) {
-    if (auto *FnIR = FnAST->codegen()) {
-      fprintf(stderr, "Read function definition:");
-      FnIR->print(errs());
-      fprintf(stderr, "\n");
-      ExitOnErr(TheJIT->addModule(
-          ThreadSafeModule(std::move(TheModule), std::move(TheContext))));
-      InitializeModuleAndPassManager();
+/// FlushDefinitions - Optimize the module holding the pending definitions and
+/// hand it to the JIT as one unit, then start a new one.
+/// 优化存放待处理定义的模块，作为一个整体交给JIT，然后开始一个新模块
+static void FlushDefinitions() {
+  if (PendingDefinitions.empty())
+    return;
+
+  // Optimize the whole module before handing it to the JIT; tiered, only
+  // functions that get hot are optimized, and otherwise the JIT may optimize
+  // the module itself, when and where it compiles it.
+  // 在交给JIT之前优化整个模块；分层编译时只优化变热的函数，否则JIT可能在编译模块时
+  // 自己优化它
+  if (!TheTieredCompiler && !OptimizeInJIT)
+    TheOptimizer->run(*TheModule);
+  std::vector<std::string> Names;
+  for (Function *FnIR : PendingDefinitions) {
+    fprintf(stderr, "Read function definition:");
+    FnIR->print(errs());
+    fprintf(stderr, "\n");
+    Names.push_back(FnIR->getName().str());
+  }
+  PendingDefinitions.clear();
+
+  // With background threads, compile the module right away so it is ready
+  // when a top-level expression needs it, unless it calls functions yet to
+  // be defined.
+  // 有后台线程时马上开始编译模块，这样顶层表达式需要时它已经编译好了，除非它调用了
+  // 还没定义的函数
+  bool Prefetch = CompileThreads && !Lazy && !TheTieredCompiler &&
+                  canLinkNow(*TheModule);
+  if (TheTieredCompiler) {
+    TheTieredCompiler->addModule(std::move(TheModule), std::move(TheContext));
+  } else {
+    ThreadSafeModule TSM(std::move(TheModule), std::move(TheContext));
+    ExitOnErr(Lazy ? TheJIT->addLazyModule(std::move(TSM))
+                   : TheJIT->addModule(std::move(TSM)));
+  }
+  for (const std::string &Name : Names)
+    DefinedNames.insert(Name);
+  if (Prefetch)
+    TheJIT->compileInBackground(Names);
+  InitializeModule();
+}
+
+// 代码生成函数定义，攒够一批再交给JIT
+static bool EmitDefinition(std::unique_ptr<FunctionAST> FnAST) {
+  auto *FnIR = FnAST->codegen();
+  if (!FnIR)
+    return false;
+
+  PendingDefinitions.push_back(FnIR);
+  if (PendingDefinitions.size() >= BatchSize)
+    FlushDefinitions();
+  return true;
+}
+
+// 代码生成函数声明（原型函数）
+static void EmitExtern(std::unique_ptr<PrototypeAST> ProtoAST) {
+  if (getBuiltin(ProtoAST->getName(), ProtoAST->getArgs().size()) !=
+      Builtin::None) {
+    fprintf(stderr, "Error: Function name is taken by a builtin.\n");
+    return;
+  }
+
+  // An extern for a function defined already declares that definition, with
+  // the signature its callers were compiled against.
+  // 对已经定义的函数的extern声明的就是这个定义，使用调用者编译时的签名
+  Function *FnIR;
+  auto &Defined = FunctionProtos.lookup(ProtoAST->getName());
+  if (Defined && !Defined->isExtern()) {
+    if (Defined->getArgTypes() != ProtoAST->getArgTypes()) {
+      fprintf(stderr, "Error: Extern does not match the definition.\n");
+      return;
     }
+    FnIR = getFunction(ProtoAST->getName());
+  } else if ((FnIR = ProtoAST->codegen())) {
+    FunctionProtos[ProtoAST->getName()] = std::move(ProtoAST);
+  }
+  if (FnIR) {
+    fprintf(stderr, "Read extern: ");
+    FnIR->print(errs());
+    fprintf(stderr, "\n");
+  }
+}
+
+/// ArrayValue - How an array returned by value looks to C++.
+/// 按值返回的数组在C++里的样子
+struct ArrayValue {
+  double *Elts;
+  int64_t Len;
+};
+
+/// emitLanesWrapper - Emit "void __anon_lanes(double *Out)", storing the
+/// lanes of the vector FnIR returns to Out.  How a vector is returned depends
+/// on the CPU features the JIT compiles for, so it is not called directly.
+/// 生成"void __anon_lanes(double *Out)"，把FnIR返回的向量的各通道存到Out。向量怎么
+/// 返回取决于JIT编译用的CPU特性，所以不直接调用它
+static void emitLanesWrapper(Function *FnIR) {
+  Type *DoublePtrTy = Type::getDoublePtrTy(*TheContext);
+  Function *W = Function::Create(
+      FunctionType::get(Type::getVoidTy(*TheContext), {DoublePtrTy}, false),
+      Function::ExternalLinkage, "__anon_lanes", TheModule.get());
+  Builder->SetInsertPoint(BasicBlock::Create(*TheContext, "entry", W));
+  Value *V = Builder->CreateCall(FnIR);
+  Builder->CreateAlignedStore(
+      V,
+      Builder->CreateBitCast(W->getArg(0),
+                             PointerType::getUnqual(V->getType())),
+      Align(8));
+  Builder->CreateRetVoid();
+}
+
+/// resolveSymbol - The address the JIT has for Name, or null.
+/// JIT里Name的地址，没有则返回空
+static void *resolveSymbol(StringRef Name) {
+  auto Sym = TheJIT->lookup(Name);
+  if (!Sym) {
+    consumeError(Sym.takeError());
+    return nullptr;
+  }
+  return reinterpret_cast<void *>(Sym->getAddress());
+}
+
+// 代码生成顶层表达式，并JIT运行
+static void EmitTopLevelExpression(std::unique_ptr<FunctionAST> FnAST) {
+  // The expression may call anything defined so far, and gets a module of its
+  // own so it can be freed after running.
+  // 表达式可能调用之前定义的任何函数，而且它需要单独的模块，方便执行后释放
+  FlushDefinitions();
+
+  // Most top-level expressions run once, so interpreting them beats
+  // compiling them; calls still run the compiled functions.
+  // 大多数顶层表达式只运行一次，所以解释执行比编译快；调用的仍然是已编译的函数
+  if (Interpret)
+    if (Optional<double> Result = interpret(*FnAST, resolveSymbol)) {
+      fprintf(stderr, "Evaluated to %f\n", *Result);
+      return;
+    }
+
+  if (Function *FnIR = FnAST->codegen()) {
+    bool ReturnsArray = FnIR->getReturnType()->isStructTy();
+    bool ReturnsInt = FnIR->getReturnType()->isIntegerTy();
+    unsigned Lanes = 0;
+    if (auto *VecTy = dyn_cast<FixedVectorType>(FnIR->getReturnType())) {
+      Lanes = VecTy->getNumElements();
+      emitLanesWrapper(FnIR);
+    }
+    if (!OptimizeInJIT)
+      TheOptimizer->run(*TheModule);
+
+    // Create a ResourceTracker to track JIT'd memory allocated to our
+    // anonymous expression -- that way we can free it after executing.
+    // 创建这个方便执行后释放
+    auto RT = TheJIT->getMainJITDylib().createResourceTracker();
+
+    auto TSM = ThreadSafeModule(std::move(TheModule), std::move(TheContext));
+    ExitOnErr(TheJIT->addModule(std::move(TSM), RT));
+    InitializeModule();
+
+    // Search the JIT for the __anon_expr symbol.
+    // 搜索是否有__anon_expr这个符号
+    auto ExprSymbol =
+        ExitOnErr(TheJIT->lookup(Lanes ? "__anon_lanes" : "__anon_expr"));
+
+    // Get the symbol's address and cast it to the right type (takes no
+    // arguments, returns a double, an int or an array, or stores the lanes of
+    // a vector) so we can call it as a native function.  A number is shown as
+    // a double either way.
+    // 查找这个函数地址，并像执行普通函数一样执行它，数字不论是double还是int都按double显示
+    intptr_t Addr = ExprSymbol.getAddress();
+    if (Lanes) {
+      double Result[8];
+      ((void (*)(double *))Addr)(Result);
+      fprintf(stderr, "Evaluated to <");
+      for (unsigned i = 0; i != Lanes; ++i)
+        fprintf(stderr, i ? ", %f" : "%f", Result[i]);
+      fprintf(stderr, ">\n");
+    } else if (ReturnsArray) {
+      ArrayValue Result = ((ArrayValue(*)())Addr)();
+      fprintf(stderr, "Evaluated to an array of %lld\n",
+              (long long)Result.Len);
+    } else if (ReturnsInt) {
+      fprintf(stderr, "Evaluated to %f\n", (double)((int64_t(*)())Addr)());
+    } else {
+      fprintf(stderr, "Evaluated to %f\n", ((double (*)())Addr)());
+    }
+
+    // Delete the anonymous expression module from the JIT.
+    // 从JIT里面，删除包含这个匿名函数的模块
+    ExitOnErr(RT->remove());
+  }
+}
+
+// 解析和代码生成函数定义
+void HandleDefinition(Parser &P) {
+  if (auto FnAST = P.ParseDefinition()) {
+    // Forget the operator again if its body does not compile.
+    // 如果操作符的函数体代码生成失败，移除这个操作符
+    const PrototypeAST &Proto = FnAST->getProto();
+    bool IsBinaryOp = Proto.isBinaryOp();
+    char Op = IsBinaryOp ? Proto.getOperatorName() : 0;
+    if (!EmitDefinition(std::move(FnAST)) && IsBinaryOp)
+      P.removeBinop(Op);
   } else {
     // Skip token for error recovery.
     // 错误恢复
-    getNextToken();
+    P.getNextToken();
   }
 }
 
 // 解析和代码生成函数声明（原型函数）
-void HandleExtern() {
-  if (auto ProtoAST = ParseExtern()) {
-    if (auto *FnIR = ProtoAST->codegen()) {
-      fprintf(stderr, "Read extern: ");
-      FnIR->print(errs());
-      fprintf(stderr, "\n");
-      FunctionProtos[ProtoAST->getName()] = std::move(ProtoAST);
-    }
+void HandleExtern(Parser &P) {
+  if (auto ProtoAST = P.ParseExtern()) {
+    EmitExtern(std::move(ProtoAST));
   } else {
     // Skip token for error recovery.
     // 错误恢复
-    getNextToken();
+    P.getNextToken();
   }
 }
 
 // 解析顶层表达式，并JIT运行
-void HandleTopLevelExpression() {
+void HandleTopLevelExpression(Parser &P) {
   // Evaluate a top-level expression into an anonymous function.
   // 解析顶层表达式到一个匿名函数
-  if (auto FnAST = ParseTopLevelExpr()) {
-    if (FnAST->codegen()) {
-      // Create a ResourceTracker to track JIT'd memory allocated to our
-      // anonymous expression -- that way we can free it after executing.
-      // 创建这个方便执行后释放
-      auto RT = TheJIT->getMainJITDylib().createResourceTracker();
-
-      auto TSM = ThreadSafeModule(std::move(TheModule), std::move(TheContext));
-      ExitOnErr(TheJIT->addModule(std::move(TSM), RT));
-      InitializeModuleAndPassManager();
-
-      // Search the JIT for the __anon_expr symbol.
-      // 搜索是否有__anon_expr这个符号
-      auto ExprSymbol = ExitOnErr(TheJIT->lookup("__anon_expr"));
-
-      // Get the symbol's address and cast it to the right type (takes no
-      // arguments, returns a double) so we can call it as a native function.
-      // 查找这个函数地址，并像执行普通函数一样执行它
-      double (*FP)() = (double (*)())(intptr_t)ExprSymbol.getAddress();
-      fprintf(stderr, "Evaluated to %f\n", FP());
-
-      // Delete the anonymous expression module from the JIT.
-      // 从JIT里面，删除包含这个匿名函数的模块
-      ExitOnErr(RT->remove());
-    }
+  if (auto FnAST = P.ParseTopLevelExpr()) {
+    EmitTopLevelExpression(std::move(FnAST));
   } else {
     // Skip token for error recovery.
     // 错误恢复
-    getNextToken();
+    P.getNextToken();
   }
 }
 
 /// top ::= definition | external | expression | ';'
 /// 主循环
-void MainLoop() {
+void MainLoop(Parser &P) {
   while (true) {
-    fprintf(stderr, "ready> ");
-    switch (CurTok) {
+    if (Prompt)
+      fprintf(stderr, "ready> ");
+    switch (P.getCurTok()) {
     case tok_eof:
       return;
     case ';': // ignore top-level semicolons. 跳过分号
-      getNextToken();
+      P.getNextToken();
       break;
     case tok_def:
-      HandleDefinition();
+      HandleDefinition(P);
       break;
     case tok_extern:
-      HandleExtern();
+      HandleExtern(P);
       break;
     default:
-      HandleTopLevelExpression();
+      HandleTopLevelExpression(P);
       break;
     }
   }
 }
 
+/// openSources - Open every input file, in command line order.
+/// 按命令行的顺序打开所有输入文件
+static bool openSources(std::vector<std::unique_ptr<SourceBuffer>> &Sources) {
+  for (const std::string &Path : InputFilenames) {
+    std::string Err;
+    auto Src = SourceBuffer::getFile(Path, Err);
+    if (!Src) {
+      fprintf(stderr, "Error: cannot open '%s': %s\n", Path.c_str(),
+              Err.c_str());
+      return false;
+    }
+    Sources.push_back(std::move(Src));
+  }
+  return true;
+}
 
+/// FinishCompiling - Hand the last definitions to the JIT and wait for the
+/// tiered compiler's recompilations.
+/// 把最后的定义交给JIT，并等待分层编译器的重新编译完成
+static void FinishCompiling() {
+  FlushDefinitions();
+  TheTieredCompiler.reset();
+  if (ObjectCacheStats)
+    if (DiskObjectCache *Cache = TheJIT->getObjectCache())
+      Cache->printStatistics(errs());
+}
+
+/// usesOperator - Whether E applies the binary operator Op.
+/// E是否使用了二元操作符Op
+static bool usesOperator(const ExprPool &Pool, ExprRef E, char Op) {
+  if (!E)
+    return false;
+  switch (E.getKind()) {
+  case ExprKind::Number:
+  case ExprKind::Integer:
+  case ExprKind::Variable:
+    return false;
+  case ExprKind::Index:
+    return usesOperator(Pool, Pool.getIndex(E).Index, Op);
+  case ExprKind::Unary:
+    return usesOperator(Pool, Pool.getUnary(E).Operand, Op);
+  case ExprKind::Binary: {
+    const BinaryExpr &B = Pool.getBinary(E);
+    return B.Op == Op || usesOperator(Pool, B.LHS, Op) ||
+           usesOperator(Pool, B.RHS, Op);
+  }
+  case ExprKind::Call:
+    return llvm::any_of(Pool.getArgs(Pool.getCall(E)), [&](ExprRef Arg) {
+      return usesOperator(Pool, Arg, Op);
+    });
+  case ExprKind::If: {
+    const IfExpr &I = Pool.getIf(E);
+    return usesOperator(Pool, I.Cond, Op) || usesOperator(Pool, I.Then, Op) ||
+           usesOperator(Pool, I.Else, Op);
+  }
+  case ExprKind::For: {
+    const ForExpr &F = Pool.getFor(E);
+    return usesOperator(Pool, F.Start, Op) || usesOperator(Pool, F.End, Op) ||
+           usesOperator(Pool, F.Step, Op) || usesOperator(Pool, F.Body, Op);
+  }
+  case ExprKind::Var: {
+    const VarExpr &V = Pool.getVar(E);
+    for (const VarBinding &B : Pool.getBindings(V))
+      if (usesOperator(Pool, B.Init, Op))
+        return true;
+    return usesOperator(Pool, V.Body, Op);
+  }
+  }
+  llvm_unreachable("unknown expression kind");
+}
+
+/// ParallelMain - Parse the sources concurrently, then generate code for the
+/// items in source order.  A file defining binary operators changes how the
+/// files after it parse, so only the files up to the first one that may
+/// define any are parsed concurrently; the rest are parsed one after another,
+/// continuing its operator table.  Parsing is done before any code is
+/// generated, so where reading the sources one by one would forget an
+/// operator whose body fails to compile, the later items using it are
+/// reported and skipped instead.
+/// 并发解析输入源，然后按顺序代码生成。定义二元操作符的文件会改变之后文件的解析方式，
+/// 所以只有到第一个可能定义操作符的文件为止的文件并发解析；其余的文件按顺序解析，
+/// 继续使用它的操作符表。解析在代码生成之前就完成了，所以逐个读取输入源时会因为函数体
+/// 代码生成失败而被移除的操作符，这里改为报告并跳过之后使用它的结构
+static int ParallelMain(std::vector<std::unique_ptr<SourceBuffer>> &Sources) {
+  size_t Concurrent = 0;
+  while (Concurrent != Sources.size() &&
+         !Sources[Concurrent++]->mayContain("binary"))
+    ;
+
+  std::vector<std::vector<TopLevelItem>> Parsed(Sources.size());
+  std::map<char, int> Operators;
+  {
+    ThreadPool Pool(hardware_concurrency(ParseJobs));
+    for (size_t I = 0; I != Concurrent; ++I)
+      Pool.async([&, I] {
+        Parser P(*Sources[I]);
+        Parsed[I] = P.ParseAll();
+        if (I == Concurrent - 1)
+          Operators = P.getBinopPrecedence();
+      });
+    Pool.wait();
+  }
+  for (size_t I = Concurrent, E = Sources.size(); I != E; ++I) {
+    Parser P(*Sources[I]);
+    P.setBinopPrecedence(Operators);
+    Parsed[I] = P.ParseAll();
+    Operators = P.getBinopPrecedence();
+  }
+
+  std::string FailedOperators;
+  for (auto &Items : Parsed) {
+    for (auto &Item : Items) {
+      if (Item.Fn) {
+        const PrototypeAST &Proto = Item.Fn->getProto();
+        char Op = Proto.isBinaryOp() ? Proto.getOperatorName() : 0;
+        auto Failed = llvm::find_if(FailedOperators, [&](char Failed) {
+          return usesOperator(Item.Fn->getPool(), Item.Fn->getBody(), Failed);
+        });
+        if (Failed != FailedOperators.end()) {
+          fprintf(stderr, "Error: Operator '%c' failed to compile\n", *Failed);
+          if (Op && !llvm::is_contained(FailedOperators, Op))
+            FailedOperators += Op;
+          continue;
+        }
+        if (Item.Kind == TopLevelItem::Definition && Op) {
+          llvm::erase_value(FailedOperators, Op);
+          if (!EmitDefinition(std::move(Item.Fn)))
+            FailedOperators += Op;
+          continue;
+        }
+      }
+
+      switch (Item.Kind) {
+      case TopLevelItem::Definition:
+        EmitDefinition(std::move(Item.Fn));
+        break;
+      case TopLevelItem::Extern:
+        EmitExtern(std::move(Item.Proto));
+        break;
+      case TopLevelItem::Expression:
+        EmitTopLevelExpression(std::move(Item.Fn));
+        break;
+      }
+    }
+  }
+  FinishCompiling();
+  return 0;
+}
 
 //===----------------------------------------------------------------------===//
 // Main driver code.
 //===----------------------------------------------------------------------===//
 // 入口
-int main() {
+int main(int argc, char **argv) {
+  // -pass-remarks=<regex> reports what the optimizer did, e.g.
+  // -pass-remarks=tailcallelim the tail calls that became loops.
+  // -pass-remarks=<正则>报告优化器做了什么，比如-pass-remarks=tailcallelim报告变成循环的尾调用
+  if (cl::Option *Remarks = cl::getRegisteredOptions().lookup("pass-remarks")) {
+    Remarks->addCategory(KaleidoscopeCategory);
+    Remarks->setHiddenFlag(cl::NotHidden);
+  }
+  cl::HideUnrelatedOptions(KaleidoscopeCategory);
+  cl::ParseCommandLineOptions(argc, argv, "Kaleidoscope JIT\n");
+
   InitializeNativeTarget();
   InitializeNativeTargetAsmPrinter();
   InitializeNativeTargetAsmParser();
 
-  // Install standard binary operators.
-  // 1 is lowest precedence.
-  // 安装标准二元操作符
-  // 1是最低的优先级
-  BinopPrecedence['='] = 2;
-  BinopPrecedence['<'] = 10;
-  BinopPrecedence['+'] = 20;
-  BinopPrecedence['-'] = 20;
-  BinopPrecedence['*'] = 40; // highest. 最高优先级
+  TheJIT = ExitOnErr(KaleidoscopeJIT::Create(
+      HostCPU, CompileThreads, ObjectCacheDir,
+      static_cast<uint64_t>(ObjectCacheSize) << 20));
+  TheOptimizer = std::make_unique<Optimizer>(
+      ExitOnErr(TheJIT->createTargetMachine()), getOptimizationLevel());
+  // Lazily or on background threads, modules are optimized when the JIT
+  // compiles them, each thread with a TargetMachine of its own.
+  // 延迟编译或使用后台线程时，JIT编译模块时才优化它，每个线程使用自己的TargetMachine
+  OptimizeInJIT = !Tiered && (Lazy || CompileThreads);
+  if (OptimizeInJIT)
+    TheJIT->setOptimizer([](Module &M) {
+      thread_local std::unique_ptr<Optimizer> ThreadOptimizer;
+      if (!ThreadOptimizer)
+        ThreadOptimizer = std::make_unique<Optimizer>(
+            ExitOnErr(TheJIT->createTargetMachine()), getOptimizationLevel());
+      ThreadOptimizer->run(M);
+    });
+  if (Tiered)
+    TheTieredCompiler = std::make_unique<TieredCompiler>(
+        ExitOnErr(TheJIT->createTargetMachine()), getOptimizationLevel());
 
-  // Prime the first token.
-  // 开始读取关键字，这时候定位在一个关键字
-  fprintf(stderr, "ready> ");
-  getNextToken();
+  InitializeModule();
 
-  TheJIT = ExitOnErr(KaleidoscopeJIT::Create());
+  // With no input files, read the REPL from stdin.
+  // 没有输入文件时，从标准输入读取
+  if (InputFilenames.empty())
+    InputFilenames.push_back("-");
 
-  InitializeModuleAndPassManager();
+  std::vector<std::unique_ptr<SourceBuffer>> Sources;
+  if (!openSources(Sources))
+    return 1;
 
-  // Run the main "interpreter loop" now.
-  // 运行循环，不断编译
-  MainLoop();
+  if (ParseJobs != 1 && Sources.size() > 1)
+    return ParallelMain(Sources);
+
+  // Sources are read one after another; each continues with the operators
+  // the previous ones defined.
+  // 按顺序读取输入源，每个输入源继续使用之前定义的操作符
+  std::map<char, int> Operators;
+  for (auto &Src : Sources) {
+    Parser P(*Src);
+    if (!Operators.empty())
+      P.setBinopPrecedence(Operators);
+    Prompt = Src->isSTDIN();
+
+    // Prime the first token.
+    // 开始读取关键字，这时候定位在一个关键字
+    if (Prompt)
+      fprintf(stderr, "ready> ");
+    P.getNextToken();
+
+    // Run the main "interpreter loop" now.
+    // 运行循环，不断编译
+    MainLoop(P);
+    Operators = P.getBinopPrecedence();
+  }
+  FinishCompiling();
 
   return 0;
-}
\ No newline at end of file
+}
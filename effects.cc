@@ -0,0 +1,154 @@
+//===----------------------------------------------------------------------===//
+// Effect analysis
+// 效果分析
+//===----------------------------------------------------------------------===//
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "ast.h"
+#include "codegen.h"
+#include "effects.h"
+#include "types.h"
+
+namespace {
+/// EffectAnalysis - Walks a function body, starting from no effects at all
+/// and adding those of every node.  A body touches memory only through
+/// arrays: reading an element reads, storing one, array() and free() may
+/// change anything.
+/// 遍历函数体，从没有任何效果开始，加上每个节点的效果。函数体只通过数组访问内存：
+/// 读元素是读，写元素、array()和free()可能改变任何东西
+class EffectAnalysis {
+  const PrototypeAST &Proto;
+  const ExprPool &Pool;
+  FunctionEffects Effects;
+
+  void call(Symbol Callee) {
+    // Recursion keeps the effects of the rest of the body.
+    // 递归保留函数体其余部分的效果
+    if (Callee == Proto.getName()) {
+      Effects.WillReturn = Effects.NoRecurse = false;
+      return;
+    }
+    if (auto &P = FunctionProtos.lookup(Callee))
+      Effects = joinEffects(Effects, P->getEffects());
+    else
+      Effects = joinEffects(Effects, FunctionEffects());
+  }
+
+  void accessMemory(FunctionEffects::MemoryKind Memory) {
+    Effects.Memory = std::max(Effects.Memory, Memory);
+  }
+
+public:
+  EffectAnalysis(const PrototypeAST &Proto, const ExprPool &Pool)
+      : Proto(Proto), Pool(Pool) {
+    Effects.Memory = FunctionEffects::NoMemory;
+    Effects.NoUnwind = Effects.WillReturn = Effects.NoRecurse = true;
+  }
+
+  const FunctionEffects &getEffects() const { return Effects; }
+
+  void visit(ExprRef E);
+};
+} // end anonymous namespace
+
+void EffectAnalysis::visit(ExprRef E) {
+  switch (E.getKind()) {
+  case ExprKind::Number:
+  case ExprKind::Integer:
+  case ExprKind::Variable:
+    return;
+  case ExprKind::Index:
+    // The bounds check may trap.
+    // 边界检查可能trap
+    visit(Pool.getIndex(E).Index);
+    accessMemory(FunctionEffects::ReadsMemory);
+    Effects.WillReturn = false;
+    return;
+  case ExprKind::Unary: {
+    const UnaryExpr &U = Pool.getUnary(E);
+    visit(U.Operand);
+    call(getOperatorSymbol(false, U.Opcode));
+    return;
+  }
+  case ExprKind::Binary: {
+    const BinaryExpr &B = Pool.getBinary(E);
+    visit(B.RHS);
+    if (B.Op == '=') {
+      if (B.LHS.getKind() == ExprKind::Index) {
+        visit(Pool.getIndex(B.LHS).Index);
+        accessMemory(FunctionEffects::AnyMemory);
+        Effects.WillReturn = false;
+      }
+      return;
+    }
+    visit(B.LHS);
+    switch (B.Op) {
+    case '+':
+    case '-':
+    case '*':
+    case '<':
+      return;
+    default:
+      call(getOperatorSymbol(true, B.Op));
+      return;
+    }
+  }
+  case ExprKind::Call: {
+    const CallExpr &C = Pool.getCall(E);
+    for (ExprRef Arg : Pool.getArgs(C))
+      visit(Arg);
+    switch (getBuiltin(C.Callee, C.NumArgs)) {
+    case Builtin::Array:
+    case Builtin::Free:
+      accessMemory(FunctionEffects::AnyMemory);
+      return;
+    case Builtin::None:
+      break;
+    default:
+      return;
+    }
+    // Math intrinsics do not set errno.
+    // 数学intrinsic不设置errno
+    if (!getMathIntrinsic(C.Callee, C.NumArgs))
+      call(C.Callee);
+    return;
+  }
+  case ExprKind::If: {
+    const IfExpr &I = Pool.getIf(E);
+    visit(I.Cond);
+    visit(I.Then);
+    visit(I.Else);
+    return;
+  }
+  case ExprKind::For: {
+    // Loops are not proven to end.
+    // 不证明循环会结束
+    const ForExpr &F = Pool.getFor(E);
+    visit(F.Start);
+    visit(F.End);
+    if (F.Step)
+      visit(F.Step);
+    visit(F.Body);
+    Effects.WillReturn = false;
+    return;
+  }
+  case ExprKind::Var: {
+    // Stack arrays are the function's own memory.
+    // 栈上数组是函数自己的内存
+    const VarExpr &V = Pool.getVar(E);
+    for (const VarBinding &B : Pool.getBindings(V))
+      if (B.Init)
+        visit(B.Init);
+    visit(V.Body);
+    return;
+  }
+  }
+  llvm_unreachable("unknown expression kind");
+}
+
+FunctionEffects inferEffects(const PrototypeAST &Proto, const ExprPool &Pool,
+                             ExprRef Body) {
+  EffectAnalysis Analysis(Proto, Pool);
+  Analysis.visit(Body);
+  return Analysis.getEffects();
+}
@@ -0,0 +1,19 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "ast.h"
+
+//===----------------------------------------------------------------------===//
+// Effect analysis
+// 效果分析
+//===----------------------------------------------------------------------===//
+
+/// inferEffects - What calling Proto, whose body is Body, may do.  Calls take
+/// the effects recorded in FunctionProtos, so externs such as putchard make
+/// their callers impure; calls to Proto itself only make it recursive.
+/// 推导调用Proto（函数体为Body）可能产生的效果。函数调用使用FunctionProtos里记录的
+/// 效果，所以调用putchard这样的外部函数的函数也不纯；对Proto自身的调用只让它成为递归函数
+FunctionEffects inferEffects(const PrototypeAST &Proto, const ExprPool &Pool,
+                             ExprRef Body);
+
+#endif // EFFECTS_H
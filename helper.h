@@ -3,9 +3,9 @@
 
 /// LogError* - These are little helper functions for error handling.
 /// 错误日志输出
-inline std::unique_ptr<ExprAST> LogError(const char *Str) {
+inline ExprRef LogError(const char *Str) {
   fprintf(stderr, "Error: %s\n", Str);
-  return nullptr;
+  return ExprRef();
 }
 
 inline std::unique_ptr<PrototypeAST> LogErrorP(const char *Str) {
@@ -0,0 +1,56 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+// String interning
+// 字符串驻留
+//===----------------------------------------------------------------------===//
+
+/// Symbol - A compact id for an interned identifier.  Equal names always get
+/// the same id, so the AST and symbol tables can compare and index by it.
+/// 标识符驻留后的紧凑id，相同的名字总是得到相同的id，所以语法树和符号表可以直接用它比较和索引
+typedef uint32_t Symbol;
+
+/// StringInterner - Maps each distinct string to a dense Symbol and back.  It
+/// is shared by parsers running on different threads, hence the lock.
+/// 把每个不同的字符串映射到一个连续的Symbol，也可以反过来查。多个线程的解析器共享它，所以要加锁
+class StringInterner {
+  mutable std::mutex Lock;
+  llvm::StringMap<Symbol> Ids;       // Owns the characters. 拥有字符串内存
+  std::vector<llvm::StringRef> Names; // Symbol -> name. 由Symbol查名字
+
+public:
+  /// intern - Return the symbol for Str, creating it on first use.
+  /// 返回Str对应的symbol，第一次使用时创建
+  Symbol intern(llvm::StringRef Str) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Ids.try_emplace(Str, (Symbol)Names.size());
+    if (It.second)
+      Names.push_back(It.first->getKey());
+    return It.first->getValue();
+  }
+
+  llvm::StringRef getName(Symbol S) const {
+    std::lock_guard<std::mutex> Guard(Lock);
+    return Names[S];
+  }
+
+  /// size - Number of symbols handed out; every Symbol is below this.
+  /// 已经分配的symbol数量，所有Symbol都小于这个值
+  size_t size() const {
+    std::lock_guard<std::mutex> Guard(Lock);
+    return Names.size();
+  }
+};
+
+/// Symbols - The interner shared by the lexer, parser and code generator.
+/// 词法分析、语法分析和代码生成共用的驻留表
+extern StringInterner Symbols;
+
+#endif // INTERNER_H
@@ -0,0 +1,637 @@
+//===----------------------------------------------------------------------===//
+// Bytecode interpreter
+// 字节码解释器
+//===----------------------------------------------------------------------===//
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "ast.h"
+#include "codegen.h"
+#include "interpreter.h"
+#include "symtab.h"
+#include "types.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+/// Register - A register of the VM holds a double or an int; the compiler
+/// knows which.
+/// 虚拟机的寄存器存放一个double或int，编译器知道是哪一个
+union Register {
+  double D;
+  int64_t I;
+};
+
+Register makeDouble(double D) {
+  Register R;
+  R.D = D;
+  return R;
+}
+
+Register makeInt(int64_t I) {
+  Register R;
+  R.I = I;
+  return R;
+}
+
+/// Opcode - The instructions, on registers A, B and C.  Int arithmetic wraps
+/// around and doubles compare unordered-or-less, as in the generated code.
+/// 指令，操作寄存器A、B和C。int运算回绕，double按“无序或小于”比较，和生成的代码一样
+enum class Opcode : uint8_t {
+  Const,       // R[A] = Consts[B]
+  Move,        // R[A] = R[B]
+  ToDouble,    // R[A] = double(R[B])
+  ToInt,       // R[A] = int(R[B])
+  AddI,        // R[A] = R[B] + R[C]
+  SubI,        // R[A] = R[B] - R[C]
+  MulI,        // R[A] = R[B] * R[C]
+  LessI,       // R[A] = double(R[B] < R[C])
+  AddD,        // R[A] = R[B] + R[C]
+  SubD,        // R[A] = R[B] - R[C]
+  MulD,        // R[A] = R[B] * R[C]
+  LessD,       // R[A] = double(R[B] < R[C])
+  Jump,        // goto B
+  JumpIfI,     // if R[A] != 0 goto B
+  JumpUnlessI, // if R[A] == 0 goto B
+  JumpIfD,     // if R[A] is nonzero and not NaN goto B
+  JumpUnlessD, // if R[A] is zero or NaN goto B
+  Call,        // R[A] = Calls[B](R[C], R[C+1], ...)
+  Return,      // return R[A]
+};
+
+/// Instr - 8 bytes; programs needing more than 16 bit operands are
+/// left to the JIT.
+/// 8个字节；需要超过16位操作数的程序交给JIT
+struct Instr {
+  Opcode Op;
+  uint16_t A, B, C;
+};
+
+/// MaxNativeArgs - The most arguments a call into compiled code can take.
+/// 调用已编译代码时最多的参数个数
+constexpr unsigned MaxNativeArgs = 6;
+
+/// NativeCall - A call into compiled code: where, and with what signature.
+/// 对已编译代码的调用：地址和函数签名
+struct NativeCall {
+  void *Addr;
+  SmallVector<ValueType, MaxNativeArgs> ArgTypes;
+  ValueType ReturnType;
+};
+
+struct Program {
+  std::vector<Instr> Code;
+  std::vector<Register> Consts;
+  std::vector<NativeCall> Calls;
+  unsigned NumRegisters = 0;
+};
+
+/// Operand - Where the compiler left a value, and its type, Int or Double.
+/// 编译器把值放在哪个寄存器，以及它的类型（Int或Double）
+struct Operand {
+  unsigned Reg;
+  ValueType Type;
+};
+
+bool isNumber(ValueType T) {
+  return T == ValueType::Double || T == ValueType::Int;
+}
+
+/// CompileState - What the compilers for a top-level expression and for the
+/// operator bodies expanded into it share.  Variables are shared too, since
+/// an expanded body sees the variables around it, as in the generated code.
+/// 顶层表达式和展开到其中的操作符函数体的编译器共享的状态。变量也是共享的，因为和生成
+/// 的代码一样，展开的函数体能看到周围的变量
+struct CompileState {
+  Program Prog;
+  ScopedSymbolTable<unsigned> Vars; // Register + 1, 0 if unbound. 寄存器号+1
+  std::vector<ValueType> RegTypes;  // Types of variable registers. 变量寄存器的类型
+  SymbolResolver Resolve;
+  bool TooBig = false;
+
+  explicit CompileState(SymbolResolver Resolve) : Resolve(Resolve) {}
+};
+
+/// BytecodeCompiler - Compiles the expressions of one ExprPool, mirroring
+/// ExprCodegen node for node.  Each expression leaves its value in a fresh
+/// register; reading a variable copies it, so a later assignment cannot
+/// change a value already read.  None means "not supported here".
+/// 编译一个节点池里的表达式，逐个节点对应ExprCodegen。每个表达式把值放在一个新寄存器里；
+/// 读变量时复制一份，这样之后的赋值不会改变已经读出的值。None表示“这里不支持”
+class BytecodeCompiler {
+  CompileState &State;
+  Program &Prog;
+  const ExprPool &Pool;
+  const FunctionTypes &Types;
+
+  unsigned newRegister() { return Prog.NumRegisters++; }
+
+  size_t emit(Opcode Op, size_t A = 0, size_t B = 0, size_t C = 0) {
+    if (std::max({A, B, C, Prog.Code.size()}) > UINT16_MAX)
+      State.TooBig = true;
+    Prog.Code.push_back({Op, uint16_t(A), uint16_t(B), uint16_t(C)});
+    return Prog.Code.size() - 1;
+  }
+
+  void bindVariable(Symbol Name, unsigned Reg, ValueType T) {
+    State.RegTypes.resize(Prog.NumRegisters);
+    State.RegTypes[Reg] = T;
+    State.Vars.bind(Name, Reg + 1);
+  }
+
+  /// here - The index of the next instruction, as a jump target.
+  /// 下一条指令的位置，用作跳转目标
+  uint16_t here() const { return uint16_t(Prog.Code.size()); }
+
+  Operand constant(Register V, ValueType T) {
+    unsigned Reg = newRegister();
+    emit(Opcode::Const, Reg, Prog.Consts.size());
+    Prog.Consts.push_back(V);
+    return {Reg, T};
+  }
+
+  /// convertInto - Store V to register Dst as a T, like convertTo.
+  /// 像convertTo一样，把V作为T存到寄存器Dst
+  void convertInto(Operand V, unsigned Dst, ValueType T) {
+    if (V.Type == T)
+      emit(Opcode::Move, Dst, V.Reg);
+    else
+      emit(T == ValueType::Double ? Opcode::ToDouble : Opcode::ToInt, Dst,
+           V.Reg);
+  }
+
+  Operand convert(Operand V, ValueType T) {
+    if (V.Type == T)
+      return V;
+    unsigned Reg = newRegister();
+    convertInto(V, Reg, T);
+    return {Reg, T};
+  }
+
+  /// number - Compile E, which must give a number.
+  /// 编译E，它必须得到一个数字
+  Optional<Operand> number(ExprRef E) {
+    Optional<Operand> V = compile(E);
+    if (!V || !isNumber(V->Type))
+      return None;
+    return V;
+  }
+
+  /// operand - Compile E, which must give a number; an integer literal is
+  /// an int when AsInt, like IntegerExpr in codegen, and a double otherwise.
+  /// 编译E，它必须得到一个数字；整数字面量在AsInt时是int（和代码生成里的IntegerExpr
+  /// 一样），否则是double
+  Optional<Operand> operand(ExprRef E, bool AsInt) {
+    if (E.getKind() != ExprKind::Integer)
+      return number(E);
+    int64_t Val = Pool.getInteger(E).Val;
+    return AsInt ? constant(makeInt(Val), ValueType::Int)
+                 : constant(makeDouble(double(Val)), ValueType::Double);
+  }
+
+  Optional<Operand> compile(const VariableExpr &E);
+  Optional<Operand> compile(const BinaryExpr &E);
+  Optional<Operand> compile(const CallExpr &E);
+  Optional<Operand> compile(const IfExpr &E);
+  Optional<Operand> compile(const ForExpr &E, ValueType VarType);
+  Optional<Operand> compile(const VarExpr &E);
+
+  Optional<Operand> compileOperator(bool IsBinary, char Op,
+                                    ArrayRef<Operand> Operands);
+  Optional<Operand> compileCall(Symbol Callee, ArrayRef<Operand> Args);
+
+public:
+  BytecodeCompiler(CompileState &State, const ExprPool &Pool,
+                   const FunctionTypes &Types)
+      : State(State), Prog(State.Prog), Pool(Pool), Types(Types) {}
+
+  Optional<Operand> compile(ExprRef E);
+
+  /// compileReturn - Compile Body and return its value as a T.
+  /// 编译Body，并把它的值作为T返回
+  bool compileReturn(ExprRef Body, ValueType T) {
+    Optional<Operand> V = number(Body);
+    if (!V)
+      return false;
+    emit(Opcode::Return, convert(*V, T).Reg);
+    return !State.TooBig;
+  }
+};
+} // end anonymous namespace
+
+Optional<Operand> BytecodeCompiler::compile(ExprRef E) {
+  switch (E.getKind()) {
+  case ExprKind::Number:
+    return constant(makeDouble(Pool.getNumber(E).Val), ValueType::Double);
+  case ExprKind::Integer:
+    return operand(E, /*AsInt=*/false);
+  case ExprKind::Variable:
+    return compile(Pool.getVariable(E));
+  case ExprKind::Unary: {
+    const UnaryExpr &U = Pool.getUnary(E);
+    Optional<Operand> V = number(U.Operand);
+    if (!V)
+      return None;
+    return compileOperator(false, U.Opcode, *V);
+  }
+  case ExprKind::Binary:
+    return compile(Pool.getBinary(E));
+  case ExprKind::Call:
+    return compile(Pool.getCall(E));
+  case ExprKind::If:
+    return compile(Pool.getIf(E));
+  case ExprKind::For:
+    return compile(Pool.getFor(E), Types.Fors[E.getIndex()]);
+  case ExprKind::Var:
+    return compile(Pool.getVar(E));
+  case ExprKind::Index:
+    return None;
+  }
+  llvm_unreachable("unknown expression kind");
+}
+
+Optional<Operand> BytecodeCompiler::compile(const VariableExpr &E) {
+  unsigned Var = State.Vars.lookup(E.Name);
+  if (!Var--)
+    return None;
+  unsigned Reg = newRegister();
+  emit(Opcode::Move, Reg, Var);
+  return Operand{Reg, State.RegTypes[Var]};
+}
+
+Optional<Operand> BytecodeCompiler::compile(const BinaryExpr &E) {
+  if (E.Op == '=') {
+    if (E.LHS.getKind() != ExprKind::Variable)
+      return None;
+    Optional<Operand> V = number(E.RHS);
+    unsigned Var = State.Vars.lookup(Pool.getVariable(E.LHS).Name);
+    if (!V || !Var--)
+      return None;
+    Operand Val = convert(*V, State.RegTypes[Var]);
+    emit(Opcode::Move, Var, Val.Reg);
+    return Val;
+  }
+
+  // An integer literal next to an int is an int too, as in codegen.
+  // 和代码生成一样，和int在一起的整数字面量也是int
+  bool IsBuiltin = E.Op == '+' || E.Op == '-' || E.Op == '*' || E.Op == '<';
+  Optional<Operand> L, R;
+  if (IsBuiltin && E.LHS.getKind() == ExprKind::Integer) {
+    R = number(E.RHS);
+    if (R)
+      L = operand(E.LHS, R->Type == ValueType::Int);
+  } else {
+    L = number(E.LHS);
+    if (L)
+      R = operand(E.RHS, IsBuiltin && L->Type == ValueType::Int);
+  }
+  if (!L || !R)
+    return None;
+
+  bool IsInt = L->Type == ValueType::Int && R->Type == ValueType::Int;
+  Opcode Op;
+  switch (E.Op) {
+  case '+':
+    Op = IsInt ? Opcode::AddI : Opcode::AddD;
+    break;
+  case '-':
+    Op = IsInt ? Opcode::SubI : Opcode::SubD;
+    break;
+  case '*':
+    Op = IsInt ? Opcode::MulI : Opcode::MulD;
+    break;
+  case '<':
+    Op = IsInt ? Opcode::LessI : Opcode::LessD;
+    break;
+  default:
+    return compileOperator(true, E.Op, {*L, *R});
+  }
+
+  if (!IsInt) {
+    L = convert(*L, ValueType::Double);
+    R = convert(*R, ValueType::Double);
+  }
+  unsigned Reg = newRegister();
+  emit(Op, Reg, L->Reg, R->Reg);
+  return Operand{Reg, E.Op != '<' && IsInt ? ValueType::Int
+                                           : ValueType::Double};
+}
+
+/// compileOperator - Expand the body of a user defined operator, typed for
+/// these operands, or call it, exactly when codegenOperator would.
+/// 在codegenOperator会展开的时候，按这些操作数的类型展开用户定义操作符的函数体，
+/// 否则调用它
+Optional<Operand> BytecodeCompiler::compileOperator(bool IsBinary, char Op,
+                                                    ArrayRef<Operand> Operands) {
+  Symbol Name = getOperatorSymbol(IsBinary, Op);
+  const KeptBody *Kept = getOperatorExpansion(Name);
+  if (!Kept)
+    return compileCall(Name, Operands);
+
+  const PrototypeAST &Proto = *FunctionProtos.lookup(Name);
+  SmallVector<ValueType, 2> OperandTypes;
+  for (const Operand &V : Operands)
+    OperandTypes.push_back(V.Type);
+  FunctionTypes ExpansionTypes =
+      inferExpansionTypes(Proto, Kept->Pool, Kept->Body, OperandTypes);
+  if (!isNumber(ExpansionTypes.Return))
+    return None;
+
+  SymbolScope<unsigned> OperatorScope(State.Vars);
+  for (unsigned i = 0, e = Operands.size(); i != e; ++i) {
+    ValueType ParamType = Proto.getArgTypes()[i];
+    ValueType T = ExpansionTypes.Args[i];
+    if (!isNumber(ParamType) || !isNumber(T))
+      return None;
+    // Operands keep their type, except that an int parameter truncates a
+    // double.
+    // 操作数保持自己的类型，只是int参数会截断double
+    Operand Arg = Operands[i];
+    if (ParamType != ValueType::Double)
+      Arg = convert(Arg, ParamType);
+    unsigned Reg = newRegister();
+    convertInto(Arg, Reg, T);
+    bindVariable(Proto.getArgs()[i], Reg, T);
+  }
+
+  ++ExpandingOperators[Name];
+  Optional<Operand> V =
+      BytecodeCompiler(State, Kept->Pool, ExpansionTypes).compile(Kept->Body);
+  --ExpandingOperators[Name];
+  if (!V || !isNumber(V->Type))
+    return None;
+  return convert(*V, ExpansionTypes.Return);
+}
+
+Optional<Operand> BytecodeCompiler::compile(const CallExpr &E) {
+  if (getBuiltin(E.Callee, E.NumArgs) != Builtin::None)
+    return None;
+  SmallVector<Operand, MaxNativeArgs> Args;
+  for (ExprRef Arg : Pool.getArgs(E)) {
+    Optional<Operand> V = number(Arg);
+    if (!V)
+      return None;
+    Args.push_back(*V);
+  }
+  return compileCall(E.Callee, Args);
+}
+
+/// compileCall - Call the compiled Callee, converting the arguments to its
+/// parameter types.  The signature is Callee's prototype in FunctionProtos,
+/// the one code generation declares it with, so an interpreted call passes
+/// and returns the same types as a compiled one.
+/// 调用已编译的Callee，把参数转换为它的参数类型。签名取自FunctionProtos里Callee的原型，
+/// 也就是代码生成声明它时用的原型，所以解释执行的调用和编译后的调用传递和返回同样的类型
+Optional<Operand> BytecodeCompiler::compileCall(Symbol Callee,
+                                                ArrayRef<Operand> Args) {
+  auto &Proto = FunctionProtos.lookup(Callee);
+  if (!Proto || Proto->getArgs().size() != Args.size() ||
+      Args.size() > MaxNativeArgs || !isNumber(Proto->getReturnType()) ||
+      !llvm::all_of(Proto->getArgTypes(), isNumber))
+    return None;
+  void *Addr = State.Resolve(Symbols.getName(Callee));
+  if (!Addr)
+    return None;
+
+  // The arguments go to consecutive registers.
+  // 参数放在连续的寄存器里
+  unsigned First = Prog.NumRegisters;
+  for (unsigned i = 0, e = Args.size(); i != e; ++i)
+    newRegister();
+  for (unsigned i = 0, e = Args.size(); i != e; ++i)
+    convertInto(Args[i], First + i, Proto->getArgTypes()[i]);
+
+  unsigned Reg = newRegister();
+  emit(Opcode::Call, Reg, Prog.Calls.size(), First);
+  Prog.Calls.push_back(
+      {Addr,
+       SmallVector<ValueType, MaxNativeArgs>(Proto->getArgTypes().begin(),
+                                             Proto->getArgTypes().end()),
+       Proto->getReturnType()});
+  return Operand{Reg, Proto->getReturnType()};
+}
+
+Optional<Operand> BytecodeCompiler::compile(const IfExpr &E) {
+  Optional<Operand> Cond = number(E.Cond);
+  if (!Cond)
+    return None;
+  size_t ToElse = emit(Cond->Type == ValueType::Int ? Opcode::JumpUnlessI
+                                                    : Opcode::JumpUnlessD,
+                       Cond->Reg);
+
+  Optional<Operand> Then = number(E.Then);
+  if (!Then)
+    return None;
+  unsigned Reg = newRegister();
+  // Becomes a conversion if the else side turns out to be a double.
+  // 如果else这边是double，这里改为转换
+  size_t ThenMove = emit(Opcode::Move, Reg, Then->Reg);
+  size_t ToEnd = emit(Opcode::Jump);
+
+  Prog.Code[ToElse].B = here();
+  Optional<Operand> Else = number(E.Else);
+  if (!Else)
+    return None;
+  ValueType T = joinTypes(Then->Type, Else->Type);
+  convertInto(*Else, Reg, T);
+  if (Then->Type != T)
+    Prog.Code[ThenMove].Op = Opcode::ToDouble;
+  Prog.Code[ToEnd].B = here();
+  return Operand{Reg, T};
+}
+
+// The general form of the loop in ExprCodegen; the counted form computes the
+// same.
+// ExprCodegen里循环的一般形式；计数形式的结果相同
+Optional<Operand> BytecodeCompiler::compile(const ForExpr &E,
+                                            ValueType VarType) {
+  if (!isNumber(VarType))
+    return None;
+  Optional<Operand> Start = operand(E.Start, VarType == ValueType::Int);
+  if (!Start)
+    return None;
+  unsigned Var = newRegister();
+  convertInto(*Start, Var, VarType);
+
+  SymbolScope<unsigned> LoopScope(State.Vars);
+  bindVariable(E.VarName, Var, VarType);
+
+  uint16_t Loop = here();
+  if (!compile(E.Body))
+    return None;
+
+  Operand Step;
+  if (E.Step) {
+    Optional<Operand> V = operand(E.Step, VarType == ValueType::Int);
+    if (!V)
+      return None;
+    Step = convert(*V, VarType);
+  } else {
+    Step = VarType == ValueType::Int ? constant(makeInt(1), VarType)
+                                     : constant(makeDouble(1.0), VarType);
+  }
+
+  Optional<Operand> EndCond = number(E.End);
+  if (!EndCond)
+    return None;
+  emit(VarType == ValueType::Int ? Opcode::AddI : Opcode::AddD, Var, Var,
+       Step.Reg);
+  emit(EndCond->Type == ValueType::Int ? Opcode::JumpIfI : Opcode::JumpIfD,
+       EndCond->Reg, Loop);
+
+  // for expr always returns 0.0.
+  // for表达式总是返回0.0
+  return constant(makeDouble(0.0), ValueType::Double);
+}
+
+Optional<Operand> BytecodeCompiler::compile(const VarExpr &E) {
+  SymbolScope<unsigned> VarScope(State.Vars);
+  for (unsigned i = 0; i != E.NumBindings; ++i) {
+    const VarBinding &B = Pool.getBindings(E)[i];
+    ValueType T = Types.Bindings[E.FirstBinding + i];
+    if (B.IsArray || !isNumber(T))
+      return None;
+
+    // The initializer cannot see the variable it initializes.
+    // 初始化表达式看不到它初始化的变量
+    Operand Init;
+    if (B.Init) {
+      Optional<Operand> V = number(B.Init);
+      if (!V)
+        return None;
+      Init = *V;
+    } else {
+      Init = T == ValueType::Int ? constant(makeInt(0), T)
+                                 : constant(makeDouble(0.0), T);
+    }
+    unsigned Var = newRegister();
+    convertInto(Init, Var, T);
+    bindVariable(B.Name, Var, T);
+  }
+  return compile(E.Body);
+}
+
+/// toInt - llvm.fptosi.sat, as convertTo emits: NaN gives 0 and out of range
+/// values the nearest int.
+/// 和convertTo生成的llvm.fptosi.sat相同：NaN得到0，超出范围的值得到最接近的int
+static int64_t toInt(double D) {
+  if (std::isnan(D))
+    return 0;
+  if (D <= -0x1p63)
+    return INT64_MIN;
+  if (D >= 0x1p63)
+    return INT64_MAX;
+  return int64_t(D);
+}
+
+/// callNative - Call Addr with Args, passing each as the type ArgTypes gives
+/// it, by picking the matching function pointer type one argument at a time.
+/// 按ArgTypes给出的类型传递每个参数调用Addr：逐个参数选出匹配的函数指针类型
+template <typename R, typename... Ts>
+static R callNative(void *Addr, ArrayRef<ValueType> ArgTypes,
+                    const Register *Args, Ts... Prefix) {
+  constexpr unsigned N = sizeof...(Ts);
+  if (N == ArgTypes.size())
+    return reinterpret_cast<R (*)(Ts...)>(Addr)(Prefix...);
+  if constexpr (N < MaxNativeArgs) {
+    if (ArgTypes[N] == ValueType::Int)
+      return callNative<R>(Addr, ArgTypes, Args, Prefix..., Args[N].I);
+    return callNative<R>(Addr, ArgTypes, Args, Prefix..., Args[N].D);
+  }
+  llvm_unreachable("too many arguments for a native call");
+}
+
+/// run - Execute P from its first instruction to its Return.
+/// 从第一条指令执行P，直到Return
+static Register run(const Program &P) {
+  std::vector<Register> R(P.NumRegisters);
+  const Instr *Code = P.Code.data();
+  for (const Instr *PC = Code;;) {
+    const Instr &I = *PC++;
+    switch (I.Op) {
+    case Opcode::Const:
+      R[I.A] = P.Consts[I.B];
+      break;
+    case Opcode::Move:
+      R[I.A] = R[I.B];
+      break;
+    case Opcode::ToDouble:
+      R[I.A] = makeDouble(double(R[I.B].I));
+      break;
+    case Opcode::ToInt:
+      R[I.A] = makeInt(toInt(R[I.B].D));
+      break;
+    case Opcode::AddI:
+      R[I.A] = makeInt(int64_t(uint64_t(R[I.B].I) + uint64_t(R[I.C].I)));
+      break;
+    case Opcode::SubI:
+      R[I.A] = makeInt(int64_t(uint64_t(R[I.B].I) - uint64_t(R[I.C].I)));
+      break;
+    case Opcode::MulI:
+      R[I.A] = makeInt(int64_t(uint64_t(R[I.B].I) * uint64_t(R[I.C].I)));
+      break;
+    case Opcode::LessI:
+      R[I.A] = makeDouble(R[I.B].I < R[I.C].I);
+      break;
+    case Opcode::AddD:
+      R[I.A] = makeDouble(R[I.B].D + R[I.C].D);
+      break;
+    case Opcode::SubD:
+      R[I.A] = makeDouble(R[I.B].D - R[I.C].D);
+      break;
+    case Opcode::MulD:
+      R[I.A] = makeDouble(R[I.B].D * R[I.C].D);
+      break;
+    case Opcode::LessD:
+      R[I.A] = makeDouble(!(R[I.B].D >= R[I.C].D));
+      break;
+    case Opcode::Jump:
+      PC = Code + I.B;
+      break;
+    case Opcode::JumpIfI:
+      if (R[I.A].I != 0)
+        PC = Code + I.B;
+      break;
+    case Opcode::JumpUnlessI:
+      if (R[I.A].I == 0)
+        PC = Code + I.B;
+      break;
+    case Opcode::JumpIfD:
+      if (R[I.A].D < 0 || R[I.A].D > 0)
+        PC = Code + I.B;
+      break;
+    case Opcode::JumpUnlessD:
+      if (!(R[I.A].D < 0 || R[I.A].D > 0))
+        PC = Code + I.B;
+      break;
+    case Opcode::Call: {
+      const NativeCall &C = P.Calls[I.B];
+      const Register *Args = &R[I.C];
+      R[I.A] = C.ReturnType == ValueType::Int
+                   ? makeInt(callNative<int64_t>(C.Addr, C.ArgTypes, Args))
+                   : makeDouble(callNative<double>(C.Addr, C.ArgTypes, Args));
+      break;
+    }
+    case Opcode::Return:
+      return R[I.A];
+    }
+  }
+}
+
+Optional<double> interpret(const FunctionAST &Fn, SymbolResolver Resolve) {
+  FunctionTypes Types = inferTypes(Fn.getProto(), Fn.getPool(), Fn.getBody());
+  if (!isNumber(Types.Return))
+    return None;
+
+  CompileState State(Resolve);
+  if (!BytecodeCompiler(State, Fn.getPool(), Types)
+           .compileReturn(Fn.getBody(), Types.Return))
+    return None;
+
+  Register Result = run(State.Prog);
+  return Types.Return == ValueType::Int ? double(Result.I) : Result.D;
+}
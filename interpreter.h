@@ -0,0 +1,31 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "ast.h"
+
+//===----------------------------------------------------------------------===//
+// Bytecode interpreter
+// 字节码解释器
+//===----------------------------------------------------------------------===//
+
+/// SymbolResolver - The address of a compiled function or an extern, or null
+/// when the JIT does not know it.
+/// 已编译函数或外部函数的地址，JIT不知道时返回空
+using SymbolResolver = llvm::function_ref<void *(llvm::StringRef Name)>;
+
+/// interpret - Run the top-level expression Fn on the bytecode interpreter
+/// and return its value, shown as a double like the JIT does.  Only numbers,
+/// variables, if, for, var, operators and calls to functions that take and
+/// return numbers are supported; for anything else, or anything the code
+/// generator would report as an error, nothing is run and None is returned,
+/// so the caller can compile Fn instead.
+/// 用字节码解释器运行顶层表达式Fn并返回它的值，和JIT一样以double显示。只支持数字、
+/// 变量、if、for、var、操作符，以及参数和结果都是数字的函数调用；遇到其他东西，或者
+/// 代码生成会报错的东西时什么都不运行并返回None，调用者可以改为编译Fn
+llvm::Optional<double> interpret(const FunctionAST &Fn,
+                                 SymbolResolver Resolve);
+
+#endif // INTERPRETER_H
@@ -4,61 +4,161 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
+#include "llvm/Support/FileSystem.h"
 #include "lexer.h"
 
-std::string IdentifierStr; // Filled in if tok_identifier 由处理tok_identifier时填充
-double NumVal;             // Filled in if tok_number 由处理tok_number时填充
+using namespace llvm;
 
+StringInterner Symbols;
 
+/// ChunkSize - How much of a stream is read per refill.
+/// 每次从流中读取的大小
+static const size_t ChunkSize = 64 * 1024;
 
-int gettok(){
-  static int LastChar = ' ';
+std::unique_ptr<SourceBuffer> SourceBuffer::getFile(StringRef Path,
+                                                    std::string &Err) {
+  if (Path == "-")
+    return getSTDIN();
+
+  // Large files are mmap'd by MemoryBuffer, small ones are read in one call.
+  // 大文件由MemoryBuffer做内存映射，小文件一次读完
+  auto FileOrErr = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!FileOrErr) {
+    Err = FileOrErr.getError().message();
+    return nullptr;
+  }
+
+  std::unique_ptr<SourceBuffer> Src(new SourceBuffer());
+  Src->File = std::move(*FileOrErr);
+  Src->Cur = Src->TokStart = Src->File->getBufferStart();
+  Src->End = Src->File->getBufferEnd();
+  Src->Name = Path.str();
+  return Src;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::getSTDIN() {
+  std::unique_ptr<SourceBuffer> Src(new SourceBuffer());
+  Src->Chunk.resize(ChunkSize);
+  Src->Cur = Src->End = Src->TokStart = Src->Chunk.data();
+  Src->Name = "<stdin>";
+  return Src;
+}
+
+bool SourceBuffer::refill() {
+  // A mapped file is already complete.
+  // 映射的文件已经是完整的了
+  if (File)
+    return false;
+
+  // Keep the pending token in front of the new data, growing the buffer if a
+  // single token is larger than it.
+  // 把未完成的关键字移到缓冲区开头，如果一个关键字比缓冲区还大，就扩大缓冲区
+  if (!InToken)
+    TokStart = End;
+  size_t Keep = End - TokStart;
+  std::memmove(Chunk.data(), TokStart, Keep);
+  if (Keep == Chunk.size())
+    Chunk.resize(Chunk.size() * 2);
+  TokStart = Chunk.data();
+  Cur = End = Chunk.data() + Keep;
+
+  auto ReadOrErr = sys::fs::readNativeFile(
+      sys::fs::getStdinHandle(),
+      MutableArrayRef<char>(Chunk.data() + Keep, Chunk.size() - Keep));
+  if (!ReadOrErr) {
+    consumeError(ReadOrErr.takeError());
+    return false;
+  }
+  End += *ReadOrErr;
+  return *ReadOrErr != 0;
+}
+
+/// getKeyword - Return the keyword token for Ident, or 0 if it is a plain
+/// identifier.  Switching on the length and first character leaves at most one
+/// string compare per identifier.
+/// 返回Ident对应的关键字，不是关键字就返回0。先按长度和首字母分支，每个标识符最多只比较一次字符串
+static int getKeyword(StringRef Ident) {
+  switch (Ident.size()) {
+  case 2:
+    if (Ident[0] == 'i')
+      return Ident == "if" ? tok_if : Ident == "in" ? tok_in : 0;
+    break;
+  case 3:
+    if (Ident[0] == 'd')
+      return Ident == "def" ? tok_def : 0;
+    if (Ident[0] == 'f')
+      return Ident == "for" ? tok_for : 0;
+    if (Ident[0] == 'v')
+      return Ident == "var" ? tok_var : 0;
+    break;
+  case 4:
+    if (Ident[0] == 't')
+      return Ident == "then" ? tok_then : 0;
+    if (Ident[0] == 'e')
+      return Ident == "else" ? tok_else : 0;
+    break;
+  case 5:
+    if (Ident[0] == 'u')
+      return Ident == "unary" ? tok_unary : 0;
+    break;
+  case 6:
+    if (Ident[0] == 'e')
+      return Ident == "extern" ? tok_extern : 0;
+    if (Ident[0] == 'b')
+      return Ident == "binary" ? tok_binary : 0;
+    break;
+  }
+  return 0;
+}
+
+Symbol Lexer::intern(StringRef Ident) {
+  auto It = Names.try_emplace(Ident, 0);
+  if (It.second)
+    It.first->second = Symbols.intern(Ident);
+  return It.first->second;
+}
+
+int Lexer::gettok() {
+  int LastChar = Src.peek();
 
   // Skip any whitespace.
   // 跳过空白字符
   while (isspace(LastChar))
-    LastChar = getchar();
+    LastChar = Src.advance();
 
   if (isalpha(LastChar)) { // identifier: [a-zA-Z][a-zA-Z0-9]* 处理标识符
-    IdentifierStr = LastChar;
-    while (isalnum((LastChar = getchar())))
-      IdentifierStr += LastChar;
-
-    if (IdentifierStr == "def")
-      return tok_def;
-    if (IdentifierStr == "extern")
-      return tok_extern;
-    if (IdentifierStr == "if")
-      return tok_if;
-    if (IdentifierStr == "then")
-      return tok_then;
-    if (IdentifierStr == "else")
-      return tok_else;
-    if (IdentifierStr == "for")
-      return tok_for;
-    if (IdentifierStr == "in")
-      return tok_in;
-    if (IdentifierStr == "binary")
-      return tok_binary;
-    if (IdentifierStr == "unary")
-      return tok_unary;
-    if (IdentifierStr == "var")
-      return tok_var;
+    Src.beginToken();
+    while (isalnum(LastChar = Src.advance()))
+      ;
+    StringRef Ident = Src.takeTokenText();
+    if (int Kw = getKeyword(Ident))
+      return Kw;
+    IdentifierSym = intern(Ident);
     return tok_identifier;
   }
 
   if (isdigit(LastChar) || LastChar == '.') { // Number: [0-9.]+ 处理数字
-    std::string NumStr;
-    do {
-      NumStr += LastChar;
-      LastChar = getchar();
-    } while (isdigit(LastChar) || LastChar == '.');
+    Src.beginToken();
+    do
+      LastChar = Src.advance();
+    while (isdigit(LastChar) || LastChar == '.');
+
+    // Digits alone make an integer, unless it is too big for 64 bits.
+    // 只有数字的是整数，除非64位放不下
+    llvm::StringRef Text = Src.takeTokenText();
+    if (!Text.contains('.') && !Text.getAsInteger(10, IntVal))
+      return tok_integer;
 
+    // The buffer is not null terminated, so give strtod its own copy.
+    // 缓冲区不是以null结尾的，所以给strtod一份拷贝
+    std::string NumStr = Text.str();
     NumVal = strtod(NumStr.c_str(), nullptr);
     return tok_number;
   }
@@ -67,7 +167,7 @@ int gettok(){
     // Comment until end of line.
     // 跳过注释和换行
     do
-      LastChar = getchar();
+      LastChar = Src.advance();
     while (LastChar != EOF && LastChar != '\n' && LastChar != '\r');
 
     if (LastChar != EOF)
@@ -82,6 +182,6 @@ int gettok(){
   // Otherwise, just return the character as its ascii value.
   // 否则返回字符的ascii的值
   int ThisChar = LastChar;
-  LastChar = getchar();
+  Src.advance();
   return ThisChar;
-}
\ No newline at end of file
+}
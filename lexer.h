@@ -1,6 +1,14 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "interner.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 //===----------------------------------------------------------------------===//
 // Lexer
 // 词法分析
@@ -37,14 +45,98 @@ enum Token {
 
   // var definition
   // 变量定义
-  tok_var = -13
+  tok_var = -13,
+
+  // integer literal, a number written without '.'
+  // 整数字面量，没有'.'的数字
+  tok_integer = -14
 };
 
-/// gettok - Return the next token from standard input.
-/// 返回标准输入的下一个关键字
-int gettok() ;
+/// SourceBuffer - The characters the lexer reads from.  A file is mapped (or
+/// read) into memory in one go; a stream such as stdin is read in large chunks,
+/// so an interactive session still sees each line as soon as it is typed.
+/// 词法分析的输入源。文件会一次性映射（或读取）到内存；标准输入这样的流按大块读取，
+/// 所以交互模式下每输入一行就能马上被处理。
+class SourceBuffer {
+  std::unique_ptr<llvm::MemoryBuffer> File; // Set for files. 文件输入时不为空
+  std::vector<char> Chunk;                  // Refill buffer for streams. 流输入的缓冲区
+  const char *Cur = nullptr, *End = nullptr;
+  const char *TokStart = nullptr; // Kept alive across refills. 重新填充时保留
+  bool InToken = false;
+  std::string Name;
+
+  bool refill();
+
+public:
+  /// getFile - Open a source file, "-" means stdin.
+  /// 打开一个源文件，"-" 表示标准输入
+  static std::unique_ptr<SourceBuffer> getFile(llvm::StringRef Path,
+                                               std::string &Err);
+  /// getSTDIN - Read from standard input chunk by chunk.
+  /// 按块读取标准输入
+  static std::unique_ptr<SourceBuffer> getSTDIN();
+
+  const std::string &getName() const { return Name; }
+  bool isSTDIN() const { return !File; }
+
+  /// mayContain - Whether Text may appear in the source: searched for in a
+  /// file, always true for stdin, which cannot be read ahead.
+  /// Text是否可能出现在输入源里：文件里直接查找，标准输入无法预读，总是返回true
+  bool mayContain(llvm::StringRef Text) const {
+    return !File || File->getBuffer().contains(Text);
+  }
+
+  /// peek - Return the current character without consuming it, or EOF.
+  /// 返回当前字符（不消费），或者EOF
+  int peek() {
+    if (Cur == End && !refill())
+      return EOF;
+    return (unsigned char)*Cur;
+  }
+
+  /// advance - Consume the current character and return the next one.
+  /// 消费当前字符，返回下一个字符
+  int advance() {
+    ++Cur;
+    return peek();
+  }
 
-extern std::string IdentifierStr; // Filled in if tok_identifier 由处理tok_identifier时填充
-extern double NumVal;             // Filled in if tok_number   由处理tok_number时填充
+  /// beginToken/takeTokenText - Remember where a token starts so its spelling
+  /// can be returned without copying it character by character.  The text
+  /// stays valid until the next character is read.
+  /// 记录一个关键字的开始位置，这样取它的文本时不用逐个字符拷贝，文本在读取下个字符前有效
+  void beginToken() {
+    TokStart = Cur;
+    InToken = true;
+  }
+  llvm::StringRef takeTokenText() {
+    InToken = false;
+    return llvm::StringRef(TokStart, Cur - TokStart);
+  }
+};
+
+/// Lexer - Turns one SourceBuffer into tokens.  All lexing state lives here,
+/// so independent sources can be lexed on different threads.
+/// 把一个输入源转换为关键字，所有状态都在对象里，所以不同的输入源可以在不同线程上分析
+class Lexer {
+  SourceBuffer &Src;
+  /// Names - Symbols this lexer has already seen, so most identifiers never
+  /// reach the shared (locked) interner.
+  /// 这个词法分析器已经见过的符号，这样大部分标识符不用访问共享（加锁）的驻留表
+  llvm::StringMap<Symbol> Names;
+
+  Symbol intern(llvm::StringRef Ident);
+
+public:
+  Symbol IdentifierSym; // Filled in if tok_identifier 由处理tok_identifier时填充
+  double NumVal;        // Filled in if tok_number   由处理tok_number时填充
+  int64_t IntVal;       // Filled in if tok_integer  由处理tok_integer时填充
+
+  explicit Lexer(SourceBuffer &Src) : Src(Src) {}
+
+  /// gettok - Return the next token from the source.
+  /// 返回输入源的下一个关键字
+  int gettok();
+};
 
-#endif // LEXER_H
\ No newline at end of file
+#endif // LEXER_H
@@ -0,0 +1,165 @@
+//===----------------------------------------------------------------------===//
+// Object cache
+// 目标文件缓存
+//===----------------------------------------------------------------------===//
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+#include <chrono>
+#include <system_error>
+#include <vector>
+#include "objectcache.h"
+
+using namespace llvm;
+
+DiskObjectCache::DiskObjectCache(StringRef Dir, uint64_t MaxBytes,
+                                 StringRef Target)
+    : Dir(Dir.str()), MaxBytes(MaxBytes), Target(Target.str()) {
+  if (std::error_code EC = sys::fs::create_directories(Dir)) {
+    errs() << "warning: cannot create object cache " << Dir << ": "
+           << EC.message() << "\n";
+    return;
+  }
+  // Start from what earlier runs left, trimmed to the cap.
+  // 从之前的运行留下的文件开始，裁剪到上限以内
+  std::lock_guard<std::mutex> Guard(Lock);
+  evict();
+}
+
+/// getPath - Where the object of M is kept: the SHA-1 of its bitcode and the
+/// target, in hex.
+/// M的目标文件保存的位置：它的bitcode和目标机器的SHA-1，用十六进制表示
+std::string DiskObjectCache::getPath(const Module &M) const {
+  SmallVector<char, 0> Bitcode;
+  raw_svector_ostream OS(Bitcode);
+  WriteBitcodeToFile(M, OS);
+
+  SHA1 Hash;
+  Hash.update(StringRef(Bitcode.data(), Bitcode.size()));
+  Hash.update(Target);
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, toHex(Hash.result(), /*LowerCase=*/true) + ".o");
+  return std::string(Path);
+}
+
+std::unique_ptr<MemoryBuffer> DiskObjectCache::getObject(const Module *M) {
+  std::string Path = getPath(*M);
+  auto Obj = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                   /*RequiresNullTerminator=*/false);
+  if (Obj) {
+    ++Hits;
+    forget(M);
+    // Using an object makes it the last one to be evicted.
+    // 使用过的目标文件最后才被删除
+    int FD;
+    if (!sys::fs::openFileForWrite(Path, FD, sys::fs::CD_OpenExisting,
+                                   sys::fs::OF_Append)) {
+      sys::fs::setLastAccessAndModificationTime(FD,
+                                                std::chrono::system_clock::now());
+      sys::Process::SafelyCloseFileDescriptor(FD);
+    }
+    return std::move(*Obj);
+  }
+
+  ++Misses;
+  std::lock_guard<std::mutex> Guard(Lock);
+  Compiling[M] = std::move(Path);
+  return nullptr;
+}
+
+void DiskObjectCache::notifyObjectCompiled(const Module *M,
+                                           MemoryBufferRef Obj) {
+  std::string Path;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Compiling.find(M);
+    if (It == Compiling.end())
+      return;
+    Path = std::move(It->second);
+    Compiling.erase(It);
+  }
+
+  // Write a temporary file and rename it, so another run reading the cache
+  // never sees half an object.
+  // 先写临时文件再改名，这样同时读取缓存的其他运行不会看到写了一半的目标文件
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Path + ".%%%%%%.tmp", FD, TempPath))
+    return;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Obj.getBuffer();
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, Path)) {
+    sys::fs::remove(TempPath);
+    return;
+  }
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  TotalBytes += Obj.getBufferSize();
+  if (TotalBytes > MaxBytes)
+    evict();
+}
+
+void DiskObjectCache::forget(const Module *M) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Compiling.erase(M);
+}
+
+/// evict - Recount the objects in Dir and, when they take more than the cap,
+/// delete the least recently used ones until they take at most 3/4 of it, so
+/// the next few objects fit without another scan.  Lock must be held.
+/// 重新统计目录里的目标文件，超过上限时删除最久没用过的文件，直到不超过上限的3/4，
+/// 这样之后的几个目标文件不用再扫描就能放下。调用时必须持有Lock
+void DiskObjectCache::evict() {
+  struct Entry {
+    std::string Path;
+    uint64_t Size;
+    sys::TimePoint<> LastUsed;
+  };
+  std::vector<Entry> Entries;
+  TotalBytes = 0;
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(Dir, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    if (sys::path::extension(I->path()) != ".o")
+      continue;
+    sys::fs::file_status Status;
+    if (sys::fs::status(I->path(), Status))
+      continue;
+    Entries.push_back(
+        {I->path(), Status.getSize(), Status.getLastModificationTime()});
+    TotalBytes += Status.getSize();
+  }
+  if (TotalBytes <= MaxBytes)
+    return;
+
+  llvm::sort(Entries, [](const Entry &A, const Entry &B) {
+    return A.LastUsed < B.LastUsed;
+  });
+  for (const Entry &Old : Entries) {
+    if (TotalBytes <= MaxBytes / 4 * 3)
+      break;
+    if (sys::fs::remove(Old.Path))
+      continue;
+    TotalBytes -= Old.Size;
+    ++Evictions;
+  }
+}
+
+void DiskObjectCache::printStatistics(raw_ostream &OS) const {
+  OS << "Object cache " << Dir << ": " << Hits << " hits, " << Misses
+     << " misses, " << Evictions << " evicted\n";
+}
@@ -0,0 +1,85 @@
+#ifndef OBJECTCACHE_H
+#define OBJECTCACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+//===----------------------------------------------------------------------===//
+// Object cache
+// 目标文件缓存
+//===----------------------------------------------------------------------===//
+
+/// DiskObjectCache - Keeps the object files the JIT compiles in a directory,
+/// named after a hash of the module's bitcode and the target, so a later run
+/// compiling the same module loads the object instead.  Once the files take
+/// more than the size cap, the least recently used ones are deleted.  Safe to
+/// use from several compiling threads.
+/// 把JIT编译出的目标文件保存在一个目录里，文件名是模块bitcode和目标机器的哈希，之后
+/// 的运行编译同样的模块时直接加载目标文件。文件总大小超过上限时，删除最久没用过的文件。
+/// 可以在多个编译线程里使用
+class DiskObjectCache : public llvm::ObjectCache {
+  std::string Dir;
+  uint64_t MaxBytes;
+  std::string Target; // LLVM version, triple, CPU and features. LLVM版本、三元组、CPU和特性
+
+  std::mutex Lock;
+  /// Keys of the modules being compiled after a miss; code generation
+  /// changes the module, so it cannot be hashed again afterwards.
+  /// 未命中后正在编译的模块的键；代码生成会修改模块，所以之后不能再算一次哈希
+  llvm::DenseMap<const llvm::Module *, std::string> Compiling;
+  uint64_t TotalBytes = 0; // Roughly what Dir holds. 目录里文件的大致总大小
+
+  std::atomic<unsigned> Hits{0}, Misses{0}, Evictions{0};
+
+  std::string getPath(const llvm::Module &M) const;
+  void evict();
+
+public:
+  DiskObjectCache(llvm::StringRef Dir, uint64_t MaxBytes,
+                  llvm::StringRef Target);
+
+  void notifyObjectCompiled(const llvm::Module *M,
+                            llvm::MemoryBufferRef Obj) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) override;
+
+  /// forget - Compiling M failed; drop the key recorded for it, so a later
+  /// module at the same address is not stored under it.
+  /// 编译M失败；丢掉为它记录的键，这样之后在同一地址的模块不会按这个键保存
+  void forget(const llvm::Module *M);
+
+  /// printStatistics - Print the hits, misses and evictions so far.
+  /// 打印到目前为止的命中、未命中和删除次数
+  void printStatistics(llvm::raw_ostream &OS) const;
+};
+
+/// CachingCompiler - A ConcurrentIRCompiler using Cache that tells it about
+/// the modules it fails to compile.
+/// 使用Cache的ConcurrentIRCompiler，编译模块失败时通知Cache
+class CachingCompiler : public llvm::orc::ConcurrentIRCompiler {
+  DiskObjectCache *Cache;
+
+public:
+  CachingCompiler(llvm::orc::JITTargetMachineBuilder JTMB,
+                  DiskObjectCache *Cache)
+      : ConcurrentIRCompiler(std::move(JTMB), Cache), Cache(Cache) {}
+
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+  operator()(llvm::Module &M) override {
+    auto Obj = ConcurrentIRCompiler::operator()(M);
+    if (!Obj && Cache)
+      Cache->forget(&M);
+    return Obj;
+  }
+};
+
+#endif // OBJECTCACHE_H
@@ -0,0 +1,114 @@
+//===----------------------------------------------------------------------===//
+// Optimizer
+// 优化器
+//===----------------------------------------------------------------------===//
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "options.h"
+#include "optimizer.h"
+
+using namespace llvm;
+
+/// OptLevelName - The levels -O accepts.
+/// -O接受的级别
+enum OptLevelName { Opt0, Opt1, Opt2, Opt3, Opts, Optz };
+
+static cl::opt<OptLevelName> OptLevel(
+    "O", cl::desc("Optimization level (default -O2):"), cl::Prefix,
+    cl::values(clEnumValN(Opt0, "0", "No optimization"),
+               clEnumValN(Opt1, "1", "Optimize quickly"),
+               clEnumValN(Opt2, "2", "Optimize"),
+               clEnumValN(Opt3, "3", "Optimize aggressively"),
+               clEnumValN(Opts, "s", "Optimize for size"),
+               clEnumValN(Optz, "z", "Optimize harder for size")),
+    cl::init(Opt2), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool>
+    Vectorize("vectorize",
+              cl::desc("Run the loop and SLP vectorizers at -O2, -O3 and -Os; "
+                       "-Oz only gets SLP (default true)"),
+              cl::init(true), cl::cat(KaleidoscopeCategory));
+
+static cl::opt<bool>
+    VectorMath("vector-math",
+               cl::desc("Let the loop vectorizer call glibc's libmvec for "
+                        "sin, cos, exp, log and pow on AVX2 hosts "
+                        "(default true)"),
+               cl::init(true), cl::cat(KaleidoscopeCategory));
+
+/// hasVectorMathLibrary - Whether loops may call libmvec: the target is
+/// x86-64 with AVX2, which libmvec's 4 x double entry points need, and the
+/// library loads, so the JIT can resolve its symbols.
+/// 循环能否调用libmvec：目标是带AVX2的x86-64（libmvec的4 x double入口需要），
+/// 并且库能加载，这样JIT能解析它的符号
+static bool hasVectorMathLibrary(const TargetMachine &TM) {
+  if (!VectorMath || TM.getTargetTriple().getArch() != Triple::x86_64 ||
+      !TM.getMCSubtargetInfo()->checkFeatures("+avx2"))
+    return false;
+  static const bool Loaded =
+      !sys::DynamicLibrary::LoadLibraryPermanently("libmvec.so.1");
+  return Loaded;
+}
+
+OptimizationLevel getOptimizationLevel() {
+  switch (OptLevel) {
+  case Opt0:
+    return OptimizationLevel::O0;
+  case Opt1:
+    return OptimizationLevel::O1;
+  case Opt2:
+    return OptimizationLevel::O2;
+  case Opt3:
+    return OptimizationLevel::O3;
+  case Opts:
+    return OptimizationLevel::Os;
+  case Optz:
+    return OptimizationLevel::Oz;
+  }
+  llvm_unreachable("unknown optimization level");
+}
+
+void Optimizer::run(Module &M) {
+  // The analysis managers cache results per module, so each run gets fresh
+  // ones; registering them is cheap next to the pipeline itself.
+  // 分析管理器按模块缓存结果，所以每次运行都新建；注册它们和运行流水线相比很便宜
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  // PassBuilder leaves both vectorizers off unless asked; pick them the way
+  // clang does for the same level.
+  // PassBuilder默认不开启两个向量化器，这里按clang对同一级别的做法开启
+  PipelineTuningOptions PTO;
+  bool Speed = Vectorize && Level.getSpeedupLevel() > 1;
+  PTO.LoopVectorization = Speed && Level.getSizeLevel() < 2;
+  PTO.SLPVectorization = Speed;
+
+  // Calls to the math intrinsics vectorize into libmvec calls only if the
+  // library info says it has them.
+  // 只有库信息里有libmvec，数学intrinsic调用才会被向量化成libmvec调用
+  TargetLibraryInfoImpl TLII(TM->getTargetTriple());
+  if (hasVectorMathLibrary(*TM))
+    TLII.addVectorizableFunctionsFromVecLib(TargetLibraryInfoImpl::LIBMVEC_X86);
+  FAM.registerPass([&] { return TargetLibraryAnalysis(TLII); });
+
+  PassBuilder PB(TM.get(), PTO);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM = Level == OptimizationLevel::O0
+                              ? PB.buildO0DefaultPipeline(Level)
+                              : PB.buildPerModuleDefaultPipeline(Level);
+  MPM.run(M, MAM);
+}
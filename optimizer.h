@@ -0,0 +1,37 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+
+//===----------------------------------------------------------------------===//
+// Optimizer
+// 优化器
+//===----------------------------------------------------------------------===//
+
+/// Optimizer - Runs the new pass manager's default pipeline for one -O level
+/// over whole modules, so module passes such as the inliner and the loop
+/// passes see every function the module defines.
+/// 用新的pass manager对整个模块运行某个-O级别的默认流水线，这样内联和循环优化这些
+/// 模块级的pass可以看到模块里定义的所有函数
+class Optimizer {
+  std::unique_ptr<llvm::TargetMachine> TM;
+  llvm::OptimizationLevel Level;
+
+public:
+  Optimizer(std::unique_ptr<llvm::TargetMachine> TM,
+            llvm::OptimizationLevel Level)
+      : TM(std::move(TM)), Level(Level) {}
+
+  /// run - Optimize M in place.
+  /// 就地优化模块M
+  void run(llvm::Module &M);
+};
+
+/// getOptimizationLevel - The level picked with -O0/-O1/-O2/-O3/-Os/-Oz.
+/// 命令行用-O0/-O1/-O2/-O3/-Os/-Oz选择的优化级别
+llvm::OptimizationLevel getOptimizationLevel();
+
+#endif // OPTIMIZER_H
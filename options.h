@@ -0,0 +1,11 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "llvm/Support/CommandLine.h"
+
+/// KaleidoscopeCategory - Command line options of our own, the only ones
+/// -help lists.  Options are declared next to the code that reads them.
+/// 我们自己的命令行选项，-help只列出这些。选项定义在使用它们的代码旁边
+extern llvm::cl::OptionCategory KaleidoscopeCategory;
+
+#endif // OPTIONS_H
@@ -38,51 +38,55 @@
 // 语法分析
 //===----------------------------------------------------------------------===//
 
-/// CurTok/getNextToken - Provide a simple token buffer.  CurTok is the current
-/// token the parser is looking at.  getNextToken reads another token from the
-/// lexer and updates CurTok with its results.
-/// 下面两个提供了简单的关键字缓存，CurTok保存解析器当前的关键字，getNextToken从词法分析获得下个关键字，并保存到CurTok
-int CurTok;
-int getNextToken() { return CurTok = gettok(); }
-
-/// BinopPrecedence - This holds the precedence for each binary operator that is
-/// defined.
-// 保存二元操作符的优先级
-std::map<char, int> BinopPrecedence;
+Parser::Parser(SourceBuffer &Src) : Lex(Src) {
+  // Install standard binary operators.
+  // 1 is lowest precedence.
+  // 安装标准二元操作符
+  // 1是最低的优先级
+  BinopPrecedence['='] = 2;
+  BinopPrecedence['<'] = 10;
+  BinopPrecedence['+'] = 20;
+  BinopPrecedence['-'] = 20;
+  BinopPrecedence['*'] = 40; // highest. 最高优先级
+}
 
 /// GetTokPrecedence - Get the precedence of the pending binary operator token.
 // 返回操作符对应的优先级
-int GetTokPrecedence() {
+int Parser::GetTokPrecedence() {
   if (!isascii(CurTok))
     return -1;
 
   // Make sure it's a declared binop.
   // 确认是定义过的二元操作
-  int TokPrec = BinopPrecedence[CurTok];
-  if (TokPrec <= 0)
+  auto It = BinopPrecedence.find(CurTok);
+  if (It == BinopPrecedence.end() || It->second <= 0)
     return -1;
-  return TokPrec;
+  return It->second;
 }
 
-
-
-std::unique_ptr<ExprAST> ParseExpression();
-
 /// numberexpr ::= number
 /// 解析数字字面量
-std::unique_ptr<ExprAST> ParseNumberExpr() {
-  auto Result = std::make_unique<NumberExprAST>(NumVal);
+ExprRef Parser::ParseNumberExpr() {
+  auto Result = Pool->addNumber(Lex.NumVal);
   getNextToken(); // consume the number 跳过这个数字
-  return std::move(Result);
+  return Result;
+}
+
+/// integerexpr ::= integer
+/// 解析整数字面量
+ExprRef Parser::ParseIntegerExpr() {
+  auto Result = Pool->addInteger(Lex.IntVal);
+  getNextToken(); // consume the integer 跳过这个整数
+  return Result;
 }
 
 /// parenexpr ::= '(' expression ')'
 /// 解析带括号的表达式
-std::unique_ptr<ExprAST> ParseParenExpr() {
+ExprRef Parser::ParseParenExpr() {
   getNextToken(); // eat (. 跳过左括号
   auto V = ParseExpression();
   if (!V)
-    return nullptr;
+    return ExprRef();
 
   if (CurTok != ')')
     return LogError("expected ')'");
@@ -92,27 +96,39 @@ std::unique_ptr<ExprAST> ParseParenExpr() {
 
 /// identifierexpr
 ///   ::= identifier
+///   ::= identifier '[' expression ']'
 ///   ::= identifier '(' expression* ')'
-// 解析标识符（有可能是一个变量，有可能是函数调用）
-std::unique_ptr<ExprAST> ParseIdentifierExpr() {
-  std::string IdName = IdentifierStr;
+// 解析标识符（有可能是一个变量，有可能是数组下标，有可能是函数调用）
+ExprRef Parser::ParseIdentifierExpr() {
+  Symbol IdName = Lex.IdentifierSym;
 
   getNextToken(); // eat identifier. 跳过标识符
 
+  if (CurTok == '[') { // Array element. 数组元素
+    getNextToken(); // eat [ 跳过左方括号
+    auto Index = ParseExpression();
+    if (!Index)
+      return ExprRef();
+    if (CurTok != ']')
+      return LogError("expected ']'");
+    getNextToken(); // eat ] 跳过右方括号
+    return Pool->addIndex(IdName, Index);
+  }
+
   if (CurTok != '(') // Simple variable ref. 简单的变量引用
-    return std::make_unique<VariableExprAST>(IdName);
+    return Pool->addVariable(IdName);
 
   // Call.
   // 否则就是函数调用
   getNextToken(); // eat ( 跳过左括号
   // 遍历，找到所有参数
-  std::vector<std::unique_ptr<ExprAST>> Args;
+  SmallVector<ExprRef, 8> Args;
   if (CurTok != ')') {
     while (true) {
       if (auto Arg = ParseExpression()) // 参数也可能是表达式
-        Args.push_back(std::move(Arg));
+        Args.push_back(Arg);
       else
-        return nullptr;
+        return ExprRef();
 
       if (CurTok == ')')
         break;
@@ -126,19 +142,19 @@ std::unique_ptr<ExprAST> ParseIdentifierExpr() {
   // Eat the ')'.跳过右括号
   getNextToken();
 
-  return std::make_unique<CallExprAST>(IdName, std::move(Args));
+  return Pool->addCall(IdName, Args);
 }
 
 /// ifexpr ::= 'if' expression 'then' expression 'else' expression
 /// 解析条件表达式
-std::unique_ptr<ExprAST> ParseIfExpr() {
+ExprRef Parser::ParseIfExpr() {
   getNextToken(); // eat the if. 跳过if
 
   // condition. 
   // 解析条件里面的表达式
   auto Cond = ParseExpression();
   if (!Cond)
-    return nullptr;
+    return ExprRef();
 
   if (CurTok != tok_then)
     return LogError("expected then");
@@ -146,7 +162,7 @@ std::unique_ptr<ExprAST> ParseIfExpr() {
 
   auto Then = ParseExpression(); // 解析then里面的表达式
   if (!Then)
-    return nullptr;
+    return ExprRef();
 
   if (CurTok != tok_else)
     return LogError("expected else");
@@ -155,21 +171,20 @@ std::unique_ptr<ExprAST> ParseIfExpr() {
 
   auto Else = ParseExpression(); // 解析else里面的表达式
   if (!Else)
-    return nullptr;
+    return ExprRef();
 
-  return std::make_unique<IfExprAST>(std::move(Cond), std::move(Then),
-                                      std::move(Else));
+  return Pool->addIf(Cond, Then, Else);
 }
 
 /// forexpr ::= 'for' identifier '=' expr ',' expr (',' expr)? 'in' expression
 /// 解析for循环表达式
-std::unique_ptr<ExprAST> ParseForExpr() {
+ExprRef Parser::ParseForExpr() {
   getNextToken(); // eat the for. 跳过for
 
   if (CurTok != tok_identifier)
     return LogError("expected identifier after for");
 
-  std::string IdName = IdentifierStr;
+  Symbol IdName = Lex.IdentifierSym;
   getNextToken(); // eat identifier. 跳过标识符
 
   if (CurTok != '=')
@@ -178,23 +193,23 @@ std::unique_ptr<ExprAST> ParseForExpr() {
 
   auto Start = ParseExpression(); // 解析标识符=后面的表达式
   if (!Start)
-    return nullptr;
+    return ExprRef();
   if (CurTok != ',')
     return LogError("expected ',' after for start value");
   getNextToken();
 
   auto End = ParseExpression(); // 解析循环判断条件表达式
   if (!End)
-    return nullptr;
+    return ExprRef();
 
   // The step value is optional.
   // 循环步长是可选的
-  std::unique_ptr<ExprAST> Step;
+  ExprRef Step;
   if (CurTok == ',') {
     getNextToken();
     Step = ParseExpression(); // 解析步长的表达式
     if (!Step)
-      return nullptr;
+      return ExprRef();
   }
 
   if (CurTok != tok_in)
@@ -203,19 +218,18 @@ std::unique_ptr<ExprAST> ParseForExpr() {
 
   auto Body = ParseExpression(); // 解析循环内容表达式
   if (!Body)
-    return nullptr;
+    return ExprRef();
 
-  return std::make_unique<ForExprAST>(IdName, std::move(Start), std::move(End),
-                                       std::move(Step), std::move(Body));
+  return Pool->addFor(IdName, Start, End, Step, Body);
 }
 
-/// varexpr ::= 'var' identifier ('=' expression)?
-//                    (',' identifier ('=' expression)?)* 'in' expression
+/// varexpr ::= 'var' binding (',' binding)* 'in' expression
+/// binding ::= identifier ('=' expression)? | identifier '[' expression ']'
 // 解析定义变量表达式
-std::unique_ptr<ExprAST> ParseVarExpr() {
+ExprRef Parser::ParseVarExpr() {
   getNextToken(); // eat the var. 跳过var
 
-  std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames;
+  SmallVector<VarBinding, 4> VarNames;
 
   // At least one variable name is required.
   // 至少要定义一个变量吧
@@ -223,21 +237,31 @@ std::unique_ptr<ExprAST> ParseVarExpr() {
     return LogError("expected identifier after var");
 
   while (true) {
-    std::string Name = IdentifierStr;
+    Symbol Name = Lex.IdentifierSym;
     getNextToken(); // eat identifier. 跳过标识符
 
-    // Read the optional initializer.
-    // 处理可选的初始化
-    std::unique_ptr<ExprAST> Init = nullptr;
-    if (CurTok == '=') {
+    // Read the optional initializer, or the size of a stack array.
+    // 处理可选的初始化，或者栈上数组的大小
+    ExprRef Init;
+    bool IsArray = CurTok == '[';
+    if (IsArray) {
+      getNextToken(); // eat the '['. 跳过‘[’
+
+      Init = ParseExpression(); // 解析数组大小的表达式
+      if (!Init)
+        return ExprRef();
+      if (CurTok != ']')
+        return LogError("expected ']' after array size");
+      getNextToken(); // eat the ']'. 跳过‘]’
+    } else if (CurTok == '=') {
       getNextToken(); // eat the '='. 跳过‘=’
 
       Init = ParseExpression(); // 解析初始化的表达式
       if (!Init)
-        return nullptr;
+        return ExprRef();
     }
 
-    VarNames.push_back(std::make_pair(Name, std::move(Init)));
+    VarNames.push_back({Name, Init, IsArray});
 
     // End of var list, exit loop.
     // 定义变量结束，退出循环
@@ -257,20 +281,21 @@ std::unique_ptr<ExprAST> ParseVarExpr() {
 
   auto Body = ParseExpression(); // 解析内容表达式
   if (!Body)
-    return nullptr;
+    return ExprRef();
 
-  return std::make_unique<VarExprAST>(std::move(VarNames), std::move(Body));
+  return Pool->addVar(VarNames, Body);
 }
 
 /// primary
 ///   ::= identifierexpr
 ///   ::= numberexpr
+///   ::= integerexpr
 ///   ::= parenexpr
 ///   ::= ifexpr
 ///   ::= forexpr
 ///   ::= varexpr
 /// primary 表示操作符两边的表达式
-std::unique_ptr<ExprAST> ParsePrimary() {
+ExprRef Parser::ParsePrimary() {
   switch (CurTok) {
   default:
     return LogError("unknown token when expecting an expression");
@@ -278,6 +303,8 @@ std::unique_ptr<ExprAST> ParsePrimary() {
     return ParseIdentifierExpr();
   case tok_number:
     return ParseNumberExpr();
+  case tok_integer:
+    return ParseIntegerExpr();
   case '(':
     return ParseParenExpr();
   case tok_if:
@@ -293,7 +320,7 @@ std::unique_ptr<ExprAST> ParsePrimary() {
 ///   ::= primary
 ///   ::= '!' unary
 /// 解析一元表达式
-std::unique_ptr<ExprAST> ParseUnary() {
+ExprRef Parser::ParseUnary() {
   // If the current token is not an operator, it must be a primary expr.
   // 如果当前关键字不是一个操作符，那就肯定是primary表达式
   if (!isascii(CurTok) || CurTok == '(' || CurTok == ',')
@@ -304,15 +331,14 @@ std::unique_ptr<ExprAST> ParseUnary() {
   int Opc = CurTok;
   getNextToken();
   if (auto Operand = ParseUnary()) // 递归下去，直到把所有一元解析出来
-    return std::make_unique<UnaryExprAST>(Opc, std::move(Operand));
-  return nullptr;
+    return Pool->addUnary(Opc, Operand);
+  return ExprRef();
 }
 
 /// binoprhs
 ///   ::= ('+' unary)*
 /// 解析二元操作（这个函数很巧妙，建议看多几次才明白）
-std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
-                                              std::unique_ptr<ExprAST> LHS) {
+ExprRef Parser::ParseBinOpRHS(int ExprPrec, ExprRef LHS) {
   // If this is a binop, find its precedence.
   // 根据优先级处理二元操作
   while (true) {
@@ -334,7 +360,7 @@ std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
     // 解析二元操作符后面的一元表达式
     auto RHS = ParseUnary();
     if (!RHS)
-      return nullptr;
+      return ExprRef();
 
     // If BinOp binds less tightly with RHS than the operator after RHS, let
     // the pending operator take RHS as its LHS.
@@ -342,15 +368,14 @@ std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
     // 通俗点就是遇到更高优先级的了，就在调用这个ParseBinOpRHS函数递归进去，直到遇到更小的优先级才退出（这里有点难，建议看多几次理解下）
     int NextPrec = GetTokPrecedence();
     if (TokPrec < NextPrec) {
-      RHS = ParseBinOpRHS(TokPrec + 1, std::move(RHS));
+      RHS = ParseBinOpRHS(TokPrec + 1, RHS);
       if (!RHS)
-        return nullptr;
+        return ExprRef();
     }
 
     // Merge LHS/RHS.
     // 合并左右节点
-    LHS =
-        std::make_unique<BinaryExprAST>(BinOp, std::move(LHS), std::move(RHS));
+    LHS = Pool->addBinary(BinOp, LHS, RHS);
   }
 }
 
@@ -358,12 +383,12 @@ std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
 ///   ::= unary binoprhs
 ///
 /// 表达式解析的主要入口函数
-std::unique_ptr<ExprAST> ParseExpression() {
+ExprRef Parser::ParseExpression() {
   auto LHS = ParseUnary();
   if (!LHS)
-    return nullptr;
+    return ExprRef();
 
-  return ParseBinOpRHS(0, std::move(LHS));
+  return ParseBinOpRHS(0, LHS);
 }
 
 /// prototype
@@ -371,8 +396,9 @@ std::unique_ptr<ExprAST> ParseExpression() {
 ///   ::= binary LETTER number? (id, id)
 ///   ::= unary LETTER (id)
 /// 解析原型（函数声明）（包括普通函数和操作符重载的函数）
-std::unique_ptr<PrototypeAST> ParsePrototype() {
-  std::string FnName;
+std::unique_ptr<PrototypeAST> Parser::ParsePrototype() {
+  std::string OpName;
+  Symbol FnName;
 
   unsigned Kind = 0; // 0 = identifier, 1 = unary, 2 = binary.
   unsigned BinaryPrecedence = 30;
@@ -381,7 +407,7 @@ std::unique_ptr<PrototypeAST> ParsePrototype() {
   default:
     return LogErrorP("Expected function name in prototype");
   case tok_identifier:
-    FnName = IdentifierStr;
+    FnName = Lex.IdentifierSym;
     Kind = 0;
     getNextToken();
     break;
@@ -389,8 +415,9 @@ std::unique_ptr<PrototypeAST> ParsePrototype() {
     getNextToken();
     if (!isascii(CurTok))
       return LogErrorP("Expected unary operator");
-    FnName = "unary";
-    FnName += (char)CurTok;
+    OpName = "unary";
+    OpName += (char)CurTok;
+    FnName = Symbols.intern(OpName);
     Kind = 1;
     getNextToken();
     break;
@@ -398,28 +425,65 @@ std::unique_ptr<PrototypeAST> ParsePrototype() {
     getNextToken();
     if (!isascii(CurTok))
       return LogErrorP("Expected binary operator");
-    FnName = "binary";
-    FnName += (char)CurTok;
+    OpName = "binary";
+    OpName += (char)CurTok;
+    FnName = Symbols.intern(OpName);
     Kind = 2;
     getNextToken();
 
     // Read the precedence if present.
     // 如果有优先级，就读取他
-    if (CurTok == tok_number) {
-      if (NumVal < 1 || NumVal > 100)
+    if (CurTok == tok_integer || CurTok == tok_number) {
+      double Prec = CurTok == tok_integer ? Lex.IntVal : Lex.NumVal;
+      if (Prec < 1 || Prec > 100)
         return LogErrorP("Invalid precedence: must be 1..100");
-      BinaryPrecedence = (unsigned)NumVal;
+      BinaryPrecedence = (unsigned)Prec;
       getNextToken();
     }
     break;
   }
 
+  return ParsePrototypeArgs(FnName, Kind, BinaryPrecedence);
+}
+
+/// ParsePrototypeArgs - The '(' id* ')' part of a prototype.  Kind is 0 for
+/// a plain function, 1 for a unary and 2 for a binary operator.
+/// 原型的'(' id* ')'部分。Kind为0表示普通函数，1表示一元操作符，2表示二元操作符
+std::unique_ptr<PrototypeAST>
+Parser::ParsePrototypeArgs(Symbol FnName, unsigned Kind,
+                           unsigned BinaryPrecedence) {
   if (CurTok != '(')
     return LogErrorP("Expected '(' in prototype");
 
-  std::vector<std::string> ArgNames;
-  while (getNextToken() == tok_identifier)
-    ArgNames.push_back(IdentifierStr);
+  // Arguments are doubles unless annotated, as in "x:int" or "a:array".
+  // 参数默认是double，除非像"x:int"或"a:array"这样标注了类型
+  static const std::pair<Symbol, ValueType> TypeNames[] = {
+      {Symbols.intern("double"), ValueType::Double},
+      {Symbols.intern("int"), ValueType::Int},
+      {Symbols.intern("array"), ValueType::Array},
+      {Symbols.intern("vec2"), ValueType::Vec2},
+      {Symbols.intern("vec4"), ValueType::Vec4},
+      {Symbols.intern("vec8"), ValueType::Vec8},
+  };
+  std::vector<Symbol> ArgNames;
+  std::vector<ValueType> ArgTypes;
+  getNextToken(); // eat '('. 跳过'('
+  while (CurTok == tok_identifier) {
+    ArgNames.push_back(Lex.IdentifierSym);
+    ArgTypes.push_back(ValueType::Double);
+    if (getNextToken() != ':')
+      continue;
+    getNextToken(); // eat ':'. 跳过':'
+    auto *It = CurTok != tok_identifier
+                   ? std::end(TypeNames)
+                   : llvm::find_if(TypeNames, [&](const auto &T) {
+                       return T.first == Lex.IdentifierSym;
+                     });
+    if (It == std::end(TypeNames))
+      return LogErrorP("Expected a type after ':' in prototype");
+    ArgTypes.back() = It->second;
+    getNextToken(); // eat the type. 跳过类型
+  }
   if (CurTok != ')')
     return LogErrorP("Expected ')' in prototype");
 
@@ -432,38 +496,113 @@ std::unique_ptr<PrototypeAST> ParsePrototype() {
     return LogErrorP("Invalid number of operands for operator");
 
   return std::make_unique<PrototypeAST>(FnName, ArgNames, Kind != 0,
-                                         BinaryPrecedence);
+                                         BinaryPrecedence, ArgTypes);
 }
 
-/// definition ::= 'def' prototype expression
+/// definition ::= 'def' ('fast' | 'memo')* prototype expression
 /// 解析函数定义表达式
- std::unique_ptr<FunctionAST> ParseDefinition() {
+std::unique_ptr<FunctionAST> Parser::ParseDefinition() {
   getNextToken(); // eat def. 跳过'def'
-  auto Proto = ParsePrototype();
+
+  // An attribute is only an attribute when a prototype follows; "def fast(x)"
+  // still defines a function called fast.
+  // 只有后面跟着原型时才是属性；"def fast(x)"仍然定义名为fast的函数
+  static const Symbol FastAttr = Symbols.intern("fast");
+  static const Symbol MemoAttr = Symbols.intern("memo");
+  bool Fast = false, Memo = false;
+  std::unique_ptr<PrototypeAST> Proto;
+  for (;;) {
+    if (CurTok != tok_identifier ||
+        (Lex.IdentifierSym != FastAttr && Lex.IdentifierSym != MemoAttr)) {
+      Proto = ParsePrototype();
+      break;
+    }
+    Symbol Attr = Lex.IdentifierSym;
+    getNextToken(); // eat the attribute. 跳过属性
+    if (CurTok == '(') {
+      Proto = ParsePrototypeArgs(Attr, 0, 30);
+      break;
+    }
+    (Attr == FastAttr ? Fast : Memo) = true;
+  }
   if (!Proto)
     return nullptr;
+  if (Fast)
+    Proto->setFast();
+  if (Memo)
+    Proto->setMemo();
+
+  // The body gets a pool of its own, dropped with it on a parse error.
+  // 函数体有自己的节点池，解析出错时一起释放
+  ExprPool ItemPool;
+  Pool = &ItemPool;
+  auto E = ParseExpression();
+  if (!E)
+    return nullptr;
 
-  if (auto E = ParseExpression())
-    return std::make_unique<FunctionAST>(std::move(Proto), std::move(E));
-  return nullptr;
+  // If this is an operator, install it so the rest of the source can use it.
+  // 如果是一个操作符，安装它，这样后面的代码可以使用它
+  if (Proto->isBinaryOp())
+    BinopPrecedence[Proto->getOperatorName()] = Proto->getBinaryPrecedence();
+  return std::make_unique<FunctionAST>(std::move(Proto), std::move(ItemPool),
+                                       E);
 }
 
 /// toplevelexpr ::= expression
 /// 解析顶层表达式（JIT执行开始的就是顶层表达式）
- std::unique_ptr<FunctionAST> ParseTopLevelExpr() {
+std::unique_ptr<FunctionAST> Parser::ParseTopLevelExpr() {
+  ExprPool ItemPool;
+  Pool = &ItemPool;
   if (auto E = ParseExpression()) {
     // Make an anonymous proto.
     // 创建一个匿名的原型
-    auto Proto = std::make_unique<PrototypeAST>("__anon_expr",
-                                                 std::vector<std::string>());
-    return std::make_unique<FunctionAST>(std::move(Proto), std::move(E));
+    static const Symbol AnonExpr = Symbols.intern("__anon_expr");
+    auto Proto =
+        std::make_unique<PrototypeAST>(AnonExpr, std::vector<Symbol>());
+    return std::make_unique<FunctionAST>(std::move(Proto),
+                                         std::move(ItemPool), E);
   }
   return nullptr;
 }
 
 /// external ::= 'extern' prototype
 /// 解析外部函数原型，用来引用外部的函数
- std::unique_ptr<PrototypeAST> ParseExtern() {
+std::unique_ptr<PrototypeAST> Parser::ParseExtern() {
   getNextToken(); // eat extern. 跳过‘extern’
-  return ParsePrototype();
-}
\ No newline at end of file
+  auto Proto = ParsePrototype();
+  if (Proto)
+    Proto->setExtern();
+  return Proto;
+}
+
+std::vector<TopLevelItem> Parser::ParseAll() {
+  std::vector<TopLevelItem> Items;
+  getNextToken();
+  while (true) {
+    switch (CurTok) {
+    case tok_eof:
+      return Items;
+    case ';': // ignore top-level semicolons. 跳过分号
+      getNextToken();
+      break;
+    case tok_def:
+      if (auto Fn = ParseDefinition())
+        Items.push_back({TopLevelItem::Definition, std::move(Fn), nullptr});
+      else
+        getNextToken(); // Skip token for error recovery. 错误恢复
+      break;
+    case tok_extern:
+      if (auto Proto = ParseExtern())
+        Items.push_back({TopLevelItem::Extern, nullptr, std::move(Proto)});
+      else
+        getNextToken();
+      break;
+    default:
+      if (auto Fn = ParseTopLevelExpr())
+        Items.push_back({TopLevelItem::Expression, std::move(Fn), nullptr});
+      else
+        getNextToken();
+      break;
+    }
+  }
+}
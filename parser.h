@@ -1,13 +1,86 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-extern int CurTok;
-extern std::map<char, int> BinopPrecedence;
+#include "lexer.h"
 
-int getNextToken();
+/// TopLevelItem - One parsed top-level construct, kept so a whole source can
+/// be parsed ahead of code generation.
+/// 一个解析好的顶层结构，用来在代码生成之前先把整个输入源解析完
+struct TopLevelItem {
+  enum ItemKind { Definition, Extern, Expression } Kind;
+  std::unique_ptr<FunctionAST> Fn;     // Definition, Expression
+  std::unique_ptr<PrototypeAST> Proto; // Extern
+};
 
-std::unique_ptr<FunctionAST> ParseDefinition();
-std::unique_ptr<FunctionAST> ParseTopLevelExpr();
-std::unique_ptr<PrototypeAST> ParseExtern();
+/// Parser - A recursive descent parser over one Lexer.  It owns its operator
+/// precedence table, so each source can be parsed independently.
+/// 基于一个词法分析器的递归下降解析器，拥有自己的操作符优先级表，所以每个输入源可以独立解析
+class Parser {
+  Lexer Lex;
 
-#endif // PARSER_H
\ No newline at end of file
+  /// CurTok - The current token the parser is looking at.
+  /// 解析器当前的关键字
+  int CurTok = 0;
+
+  /// BinopPrecedence - This holds the precedence for each binary operator that
+  /// is defined.
+  /// 保存二元操作符的优先级
+  std::map<char, int> BinopPrecedence;
+
+  /// Pool - Where the nodes of the item being parsed are stored.
+  /// 当前正在解析的顶层结构的节点存放在这里
+  ExprPool *Pool = nullptr;
+
+  int GetTokPrecedence();
+  ExprRef ParseNumberExpr();
+  ExprRef ParseIntegerExpr();
+  ExprRef ParseParenExpr();
+  ExprRef ParseIdentifierExpr();
+  ExprRef ParseIfExpr();
+  ExprRef ParseForExpr();
+  ExprRef ParseVarExpr();
+  ExprRef ParsePrimary();
+  ExprRef ParseUnary();
+  ExprRef ParseBinOpRHS(int ExprPrec, ExprRef LHS);
+  ExprRef ParseExpression();
+  std::unique_ptr<PrototypeAST> ParsePrototype();
+  std::unique_ptr<PrototypeAST> ParsePrototypeArgs(Symbol FnName,
+                                                   unsigned Kind,
+                                                   unsigned Precedence);
+
+public:
+  /// Parser - Start parsing Src with the standard binary operators installed.
+  /// 开始解析Src，并安装标准二元操作符
+  explicit Parser(SourceBuffer &Src);
+
+  int getCurTok() const { return CurTok; }
+
+  /// getNextToken - Read another token from the lexer and update CurTok.
+  /// 从词法分析获得下个关键字，并保存到CurTok
+  int getNextToken() { return CurTok = Lex.gettok(); }
+
+  /// setBinopPrecedence/getBinopPrecedence - The operator table, so a
+  /// following source can continue with the operators defined so far.
+  /// 操作符表，后续的输入源可以继续使用之前定义的操作符
+  const std::map<char, int> &getBinopPrecedence() const {
+    return BinopPrecedence;
+  }
+  void setBinopPrecedence(const std::map<char, int> &Table) {
+    BinopPrecedence = Table;
+  }
+
+  /// removeBinop - Forget a user operator whose definition failed to compile.
+  /// 移除一个代码生成失败的用户操作符
+  void removeBinop(char Op) { BinopPrecedence.erase(Op); }
+
+  std::unique_ptr<FunctionAST> ParseDefinition();
+  std::unique_ptr<FunctionAST> ParseTopLevelExpr();
+  std::unique_ptr<PrototypeAST> ParseExtern();
+
+  /// ParseAll - Parse the rest of the source into top-level items, skipping
+  /// past anything that fails to parse.
+  /// 把剩下的输入全部解析成顶层结构，解析失败的会被跳过
+  std::vector<TopLevelItem> ParseAll();
+};
+
+#endif // PARSER_H
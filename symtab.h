@@ -0,0 +1,80 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "interner.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+// Symbol tables
+// 符号表
+//===----------------------------------------------------------------------===//
+
+/// SymbolTable - A table indexed directly by Symbol.  Symbols are dense, so a
+/// vector beats hashing; missing entries read as a default constructed T.
+/// 直接用Symbol做下标的表。Symbol是连续的，所以用vector比哈希快；没有的项读出来是默认值
+template <typename T> class SymbolTable {
+  std::vector<T> Entries;
+
+public:
+  T &operator[](Symbol S) {
+    if (S >= Entries.size())
+      Entries.resize(S + 1);
+    return Entries[S];
+  }
+
+  const T &lookup(Symbol S) const {
+    static const T Empty{};
+    return S < Entries.size() ? Entries[S] : Empty;
+  }
+};
+
+/// ScopedSymbolTable - A SymbolTable with nested scopes.  Binding a name saves
+/// the binding it shadows on an undo log; leaving a scope pops the log back
+/// to the mark taken when the scope was entered.  Lookup, bind, enter and
+/// leave are all O(1) per binding.
+/// 带嵌套作用域的SymbolTable。绑定一个名字时，把被遮盖的旧绑定存到撤销日志里；
+/// 离开作用域时把日志弹回到进入时的位置。查找、绑定、进入和离开都是每个绑定O(1)
+template <typename T> class ScopedSymbolTable {
+  SymbolTable<T> Current;
+  std::vector<std::pair<Symbol, T>> Shadowed;
+
+public:
+  T lookup(Symbol S) const { return Current.lookup(S); }
+
+  /// bind - Bind S to V until the innermost scope is left.
+  /// 把S绑定到V，直到离开最内层的作用域
+  void bind(Symbol S, T V) {
+    T &Slot = Current[S];
+    Shadowed.emplace_back(S, Slot);
+    Slot = V;
+  }
+
+  size_t enterScope() const { return Shadowed.size(); }
+
+  void leaveScope(size_t Mark) {
+    while (Shadowed.size() > Mark) {
+      Current[Shadowed.back().first] = Shadowed.back().second;
+      Shadowed.pop_back();
+    }
+  }
+};
+
+/// SymbolScope - Enters a scope of a ScopedSymbolTable and leaves it again on
+/// destruction, so early error returns cannot leak bindings.
+/// 进入ScopedSymbolTable的一个作用域，析构时离开，这样出错提前返回也不会遗留绑定
+template <typename T> class SymbolScope {
+  ScopedSymbolTable<T> &Table;
+  size_t Mark;
+
+public:
+  explicit SymbolScope(ScopedSymbolTable<T> &Table)
+      : Table(Table), Mark(Table.enterScope()) {}
+  ~SymbolScope() { Table.leaveScope(Mark); }
+
+  SymbolScope(const SymbolScope &) = delete;
+  SymbolScope &operator=(const SymbolScope &) = delete;
+};
+
+#endif // SYMTAB_H
@@ -0,0 +1,178 @@
+//===----------------------------------------------------------------------===//
+// Tiered compilation
+// 分层编译
+//===----------------------------------------------------------------------===//
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "ast.h"
+#include "codegen.h"
+#include "options.h"
+#include "tiering.h"
+
+static cl::opt<unsigned> TierThreshold(
+    "tier-threshold",
+    cl::desc("With -tiered, recompile a function once its calls plus loop "
+             "iterations reach N (default 10000)"),
+    cl::init(10000), cl::cat(KaleidoscopeCategory));
+
+/// TierUpHook - The host function the lowest tier calls, with the address of
+/// the module's TieredModule, when one of its functions got hot.
+/// 最低层代码在某个函数变热时调用的宿主函数，参数是模块的TieredModule的地址
+static const char TierUpHook[] = "__kaleido_tier_up";
+
+/// moveBehindStubs - Rename each function in Names to name<Suffix> and declare
+/// name in its place, so every call, recursive ones included, goes through
+/// the stub of that name and reaches the newest tier.
+/// 把Names里的每个函数改名为name<Suffix>，并在原处声明name，这样所有调用（包括递归
+/// 调用）都经过同名的桩，到达最新的一层
+static void moveBehindStubs(Module &M, ArrayRef<std::string> Names,
+                            StringRef Suffix) {
+  for (const std::string &Name : Names) {
+    Function *F = M.getFunction(Name);
+    F->setName(Name + Suffix);
+    Function *Stub = Function::Create(F->getFunctionType(),
+                                      Function::ExternalLinkage, Name, M);
+    Stub->setAttributes(F->getAttributes());
+    F->replaceAllUsesWith(Stub);
+  }
+}
+
+/// countHotness - Make F add one to Counter on entry and at every loop
+/// header, and call Hook with Arg when the count reaches -tier-threshold.
+/// Counter is a plain global, so calls on several threads at once may lose
+/// counts; the count only decides when to tier up, so that is fine.
+/// 让F在入口和每个循环头把Counter加一，计数达到-tier-threshold时以Arg调用Hook。
+/// Counter是普通的全局变量，多个线程同时调用时可能少计数；计数只决定什么时候重新编译，
+/// 所以没有关系
+static void countHotness(Function &F, GlobalVariable *Counter,
+                         FunctionCallee Hook, uint64_t Arg) {
+  // A loop header is a block that dominates one of its predecessors.
+  // 循环头是支配它的某个前驱的基本块
+  DominatorTree DT(F);
+  SmallVector<BasicBlock *, 8> Heads{&F.getEntryBlock()};
+  for (BasicBlock &BB : F)
+    if (any_of(predecessors(&BB),
+               [&](BasicBlock *Pred) { return DT.dominates(&BB, Pred); }))
+      Heads.push_back(&BB);
+
+  Type *Int64Ty = Type::getInt64Ty(F.getContext());
+  MDNode *Unlikely =
+      MDBuilder(F.getContext()).createBranchWeights(1, TierThreshold);
+  for (BasicBlock *BB : Heads) {
+    // Keep the entry block's allocas in the entry block.
+    // 入口块的alloca留在入口块
+    Instruction *InsertPt = &*BB->getFirstInsertionPt();
+    while (isa<AllocaInst>(InsertPt))
+      InsertPt = InsertPt->getNextNode();
+
+    IRBuilder<> B(InsertPt);
+    Value *Count = B.CreateAdd(B.CreateLoad(Int64Ty, Counter), B.getInt64(1));
+    B.CreateStore(Count, Counter);
+    Value *Hot = B.CreateICmpEQ(Count, B.getInt64(TierThreshold));
+    IRBuilder<> Then(SplitBlockAndInsertIfThen(Hot, InsertPt, false, Unlikely));
+    Then.CreateCall(Hook, {Then.getInt64(Arg)});
+  }
+}
+
+TieredCompiler::TieredCompiler(std::unique_ptr<TargetMachine> TM,
+                               OptimizationLevel Level)
+    : TopTier(std::move(TM), Level), Pool(hardware_concurrency(1)) {
+  ExitOnErr(TheJIT->defineAbsolute(TierUpHook,
+                                   reinterpret_cast<void *>(&onHot)));
+}
+
+TieredCompiler::~TieredCompiler() { Pool.wait(); }
+
+void TieredCompiler::addModule(std::unique_ptr<Module> M,
+                               std::unique_ptr<LLVMContext> Ctx) {
+  auto TM = std::make_unique<TieredModule>();
+  TM->Owner = this;
+  for (Function &F : *M)
+    if (!F.isDeclaration() && F.hasExternalLinkage())
+      TM->Names.push_back(F.getName().str());
+  raw_svector_ostream OS(TM->Bitcode);
+  WriteBitcodeToFile(*M, OS);
+
+  // The module's code finds its TieredModule by address, which stays put
+  // while Modules grows.
+  // 模块的代码按地址找到它的TieredModule，Modules增长时这个地址不变
+  uint64_t Arg = reinterpret_cast<uintptr_t>(TM.get());
+  moveBehindStubs(*M, TM->Names, ".tier0");
+  FunctionCallee Hook = M->getOrInsertFunction(
+      TierUpHook, Type::getVoidTy(*Ctx), Type::getInt64Ty(*Ctx));
+  for (const std::string &Name : TM->Names) {
+    auto *Counter = new GlobalVariable(
+        *M, Type::getInt64Ty(*Ctx), false, GlobalValue::InternalLinkage,
+        ConstantInt::get(Type::getInt64Ty(*Ctx), 0), Name + ".count");
+    countHotness(*M->getFunction(Name + ".tier0"), Counter, Hook, Arg);
+  }
+
+  // The lowest tier is compiled when a stub is first called through.
+  // 第一次经过桩调用时才编译最低层
+  for (const std::string &Name : TM->Names)
+    ExitOnErr(TheJIT->createStub(Name, Name + ".tier0"));
+  ExitOnErr(TheJIT->addModule(ThreadSafeModule(std::move(M), std::move(Ctx)),
+                              nullptr, /*Fast=*/true));
+  Modules.push_back(std::move(TM));
+}
+
+/// onHot - Called by the lowest tier, on whatever thread runs it; queues the
+/// module's recompilation once.
+/// 由最低层代码在运行它的线程上调用；把模块的重新编译排进队列，只排一次
+void TieredCompiler::onHot(uint64_t Arg) {
+  TieredModule &TM = *reinterpret_cast<TieredModule *>(Arg);
+  if (!TM.Hot.exchange(true))
+    TM.Owner->Pool.async([&TM] { TM.Owner->tierUp(TM); });
+}
+
+/// tierUp - Optimize the module in a context of its own, so this thread
+/// shares no IR with the one generating code, compile it and redirect the
+/// stubs.  Errors are reported and leave the lowest tier in place.
+/// 在独立的上下文里优化模块，这样这个线程和代码生成线程不共享IR，然后编译它并改指桩。
+/// 出错时报告错误，保留最低层代码
+void TieredCompiler::tierUp(TieredModule &TM) {
+  auto Ctx = std::make_unique<LLVMContext>();
+  auto M = parseBitcodeFile(
+      MemoryBufferRef(StringRef(TM.Bitcode.data(), TM.Bitcode.size()),
+                      "tier1"),
+      *Ctx);
+  if (!M) {
+    logAllUnhandledErrors(M.takeError(), errs(), "tier-up: ");
+    return;
+  }
+
+  moveBehindStubs(**M, TM.Names, ".tier1");
+  TopTier.run(**M);
+  for (const std::string &Name : TM.Names)
+    if (Function *F = (*M)->getFunction(Name + ".tier1"))
+      Ctx->diagnose(OptimizationRemark("tier-up", "Recompiled", F)
+                    << "recompiled hot function " << Name);
+
+  if (auto Err = TheJIT->addModule(
+          ThreadSafeModule(std::move(*M), std::move(Ctx)))) {
+    logAllUnhandledErrors(std::move(Err), errs(), "tier-up: ");
+    return;
+  }
+  for (const std::string &Name : TM.Names) {
+    // Looking the stub up creates it if it was never called through yet.
+    // 查找桩，如果它还没被调用过就会创建它
+    auto Stub = TheJIT->lookup(Name);
+    auto Sym = Stub ? TheJIT->lookup(Name + ".tier1") : Stub.takeError();
+    if (!Sym) {
+      logAllUnhandledErrors(Sym.takeError(), errs(), "tier-up: ");
+      return;
+    }
+    if (auto Err = TheJIT->redirectStub(Name, Sym->getAddress())) {
+      logAllUnhandledErrors(std::move(Err), errs(), "tier-up: ");
+      return;
+    }
+  }
+}
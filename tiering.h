@@ -0,0 +1,63 @@
+#ifndef TIERING_H
+#define TIERING_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "optimizer.h"
+
+//===----------------------------------------------------------------------===//
+// Tiered compilation
+// 分层编译
+//===----------------------------------------------------------------------===//
+
+/// TieredCompiler - Installs the functions a module defines quickly first:
+/// unoptimized and compiled with FastISel, each behind an indirect stub of
+/// its name, counting its calls and loop iterations.  Once a counter reaches
+/// -tier-threshold, the module is optimized and compiled again on a
+/// background thread and the stubs are redirected to the new code.
+/// 先快速装入模块定义的函数：不优化、用FastISel编译，每个函数放在同名的间接桩后面，
+/// 并统计它的调用和循环次数。计数达到-tier-threshold后，在后台线程重新优化编译
+/// 这个模块，然后把桩改指向新代码
+class TieredCompiler {
+  /// TieredModule - What recompiling a module needs: its bitcode as code
+  /// generation left it, and the functions it defines.
+  /// 重新编译一个模块需要的东西：代码生成得到的bitcode，和它定义的函数
+  struct TieredModule {
+    TieredCompiler *Owner;
+    llvm::SmallVector<char, 0> Bitcode;
+    std::vector<std::string> Names;
+    std::atomic<bool> Hot{false}; // Recompilation was queued. 已经排队重新编译
+  };
+
+  /// Modules - Only keeps the modules alive; their code reaches them by
+  /// address, so it never looks at this vector.
+  /// 只负责保持模块存活；模块的代码按地址找到它们，从不访问这个vector
+  std::vector<std::unique_ptr<TieredModule>> Modules;
+  Optimizer TopTier;
+  llvm::ThreadPool Pool; // Destroyed first, waiting for recompilations. 最先析构，等待重新编译完成
+
+  void tierUp(TieredModule &TM);
+  static void onHot(uint64_t Arg);
+
+public:
+  TieredCompiler(std::unique_ptr<llvm::TargetMachine> TM,
+                 llvm::OptimizationLevel Level);
+  ~TieredCompiler();
+
+  /// addModule - Install the functions M defines at the lowest tier.  M must
+  /// not be optimized yet.
+  /// 以最低层装入M定义的函数。M必须还没有优化
+  void addModule(std::unique_ptr<llvm::Module> M,
+                 std::unique_ptr<llvm::LLVMContext> Ctx);
+};
+
+#endif // TIERING_H
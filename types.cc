@@ -0,0 +1,287 @@
+//===----------------------------------------------------------------------===//
+// Type inference
+// 类型推导
+//===----------------------------------------------------------------------===//
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "ast.h"
+#include "codegen.h"
+#include "symtab.h"
+#include "types.h"
+
+Builtin getBuiltin(Symbol Callee, size_t NumArgs) {
+  static const Symbol ArraySym = Symbols.intern("array");
+  static const Symbol LenSym = Symbols.intern("len");
+  static const Symbol FreeSym = Symbols.intern("free");
+  static const Symbol Vec2Sym = Symbols.intern("vec2");
+  static const Symbol Vec4Sym = Symbols.intern("vec4");
+  static const Symbol Vec8Sym = Symbols.intern("vec8");
+  static const Symbol HSumSym = Symbols.intern("hsum");
+  static const Symbol HMinSym = Symbols.intern("hmin");
+  static const Symbol HMaxSym = Symbols.intern("hmax");
+
+  // Vectors are built from all their lanes, or from one value for every lane.
+  // 向量由全部通道构造，或者由一个值复制到每个通道构造
+  if (Callee == Vec2Sym && (NumArgs == 2 || NumArgs == 1))
+    return Builtin::Vec2;
+  if (Callee == Vec4Sym && (NumArgs == 4 || NumArgs == 1))
+    return Builtin::Vec4;
+  if (Callee == Vec8Sym && (NumArgs == 8 || NumArgs == 1))
+    return Builtin::Vec8;
+  if (NumArgs != 1)
+    return Builtin::None;
+  if (Callee == ArraySym)
+    return Builtin::Array;
+  if (Callee == LenSym)
+    return Builtin::Len;
+  if (Callee == FreeSym)
+    return Builtin::Free;
+  if (Callee == HSumSym)
+    return Builtin::HSum;
+  if (Callee == HMinSym)
+    return Builtin::HMin;
+  if (Callee == HMaxSym)
+    return Builtin::HMax;
+  return Builtin::None;
+}
+
+namespace {
+/// TypeInference - Walks a function body with the same scoping as code
+/// generation, widening each variable to the join of the values it is given.
+/// Walks repeat until nothing changes; a type only ever widens from int to
+/// double, so that takes at most a few walks.
+/// 用和代码生成一样的作用域规则遍历函数体，把每个变量放宽为它得到的所有值的类型的并。
+/// 重复遍历直到不再变化；类型只会从int放宽到double，所以最多遍历几次
+class TypeInference {
+  const PrototypeAST &Proto;
+  const ExprPool &Pool;
+  FunctionTypes &Types;
+  bool Expansion; // Typing an operator expansion. 在推导操作符展开的类型
+  ScopedSymbolTable<ValueType *> Vars;
+  bool Changed = false;
+
+  void widen(ValueType &Slot, ValueType T) {
+    ValueType Joined = joinTypes(Slot, T);
+    if (Joined != Slot) {
+      Slot = Joined;
+      Changed = true;
+    }
+  }
+
+  ValueType getReturnType(Symbol Callee) const {
+    if (Callee == Proto.getName() && !Expansion)
+      return Types.Return;
+    if (auto &P = FunctionProtos.lookup(Callee))
+      return P->getReturnType();
+    return ValueType::Double;
+  }
+
+  /// getOperatorType - The type of applying user operator Op, expanded or
+  /// called, to operands of the given types.
+  /// 把用户操作符Op（展开或调用）作用到给定类型的操作数上得到的类型
+  ValueType getOperatorType(bool IsBinary, char Op,
+                            ArrayRef<ValueType> OperandTypes) const {
+    Symbol Name = getOperatorSymbol(IsBinary, Op);
+    if (const KeptBody *Kept = getOperatorExpansion(Name))
+      return inferExpansionTypes(*FunctionProtos.lookup(Name), Kept->Pool,
+                                 Kept->Body, OperandTypes)
+          .Return;
+    return getReturnType(Name);
+  }
+
+  ValueType infer(ExprRef E);
+
+public:
+  TypeInference(const PrototypeAST &Proto, const ExprPool &Pool,
+                FunctionTypes &Types, bool Expansion)
+      : Proto(Proto), Pool(Pool), Types(Types), Expansion(Expansion) {}
+
+  /// run - Walk Body once; return whether any type changed.
+  /// 遍历一次函数体，返回是否有类型发生变化
+  bool run(ExprRef Body) {
+    Changed = false;
+    SymbolScope<ValueType *> ArgScope(Vars);
+    for (unsigned i = 0, e = Proto.getArgs().size(); i != e; ++i)
+      Vars.bind(Proto.getArgs()[i], &Types.Args[i]);
+    widen(Types.Return, infer(Body));
+    return Changed;
+  }
+};
+} // end anonymous namespace
+
+ValueType TypeInference::infer(ExprRef E) {
+  switch (E.getKind()) {
+  case ExprKind::Number:
+    return ValueType::Double;
+  case ExprKind::Integer:
+    return ValueType::Double;
+  case ExprKind::Variable: {
+    ValueType *Slot = Vars.lookup(Pool.getVariable(E).Name);
+    return Slot ? *Slot : ValueType::Double;
+  }
+  case ExprKind::Index:
+    infer(Pool.getIndex(E).Index);
+    return ValueType::Double;
+  case ExprKind::Unary: {
+    const UnaryExpr &U = Pool.getUnary(E);
+    return getOperatorType(false, U.Opcode, infer(U.Operand));
+  }
+  case ExprKind::Binary: {
+    const BinaryExpr &B = Pool.getBinary(E);
+    if (B.Op == '=') {
+      // An assignment evaluates to the variable's new value.
+      // 赋值表达式的值是变量的新值
+      ValueType T = infer(B.RHS);
+      if (B.LHS.getKind() == ExprKind::Index) {
+        infer(Pool.getIndex(B.LHS).Index);
+        return ValueType::Double;
+      }
+      if (B.LHS.getKind() != ExprKind::Variable)
+        return ValueType::Double;
+      ValueType *Slot = Vars.lookup(Pool.getVariable(B.LHS).Name);
+      if (!Slot)
+        return ValueType::Double;
+      widen(*Slot, T);
+      return *Slot;
+    }
+    ValueType L = infer(B.LHS);
+    ValueType R = infer(B.RHS);
+    if (B.Op == '+' || B.Op == '-' || B.Op == '*' || B.Op == '<') {
+      // An integer literal next to an int counts or indexes with it.
+      // 和int在一起的整数字面量跟它一起计数或计算下标
+      if (B.LHS.getKind() == ExprKind::Integer && R == ValueType::Int)
+        L = ValueType::Int;
+      if (B.RHS.getKind() == ExprKind::Integer && L == ValueType::Int)
+        R = ValueType::Int;
+    }
+    switch (B.Op) {
+    case '+':
+    case '-':
+    case '*':
+      return joinTypes(L, R);
+    case '<':
+      // 0 or 1, in each lane for vectors.
+      // 0或1，向量则每个通道都是
+      return getVectorWidth(joinTypes(L, R)) ? joinTypes(L, R)
+                                             : ValueType::Double;
+    default:
+      return getOperatorType(true, B.Op, {L, R});
+    }
+  }
+  case ExprKind::Call: {
+    const CallExpr &C = Pool.getCall(E);
+    ValueType ArgsType = ValueType::Double;
+    for (ExprRef Arg : Pool.getArgs(C))
+      ArgsType = joinTypes(ArgsType, infer(Arg));
+    // Math functions work lane by lane on vectors.
+    // 数学函数对向量按通道计算
+    if (getMathIntrinsic(C.Callee, C.NumArgs))
+      return ArgsType;
+    switch (getBuiltin(C.Callee, C.NumArgs)) {
+    case Builtin::Array:
+      return ValueType::Array;
+    case Builtin::Len:
+      return ValueType::Int;
+    case Builtin::Vec2:
+      return ValueType::Vec2;
+    case Builtin::Vec4:
+      return ValueType::Vec4;
+    case Builtin::Vec8:
+      return ValueType::Vec8;
+    case Builtin::Free:
+    case Builtin::HSum:
+    case Builtin::HMin:
+    case Builtin::HMax:
+      return ValueType::Double;
+    case Builtin::None:
+      break;
+    }
+    return getReturnType(C.Callee);
+  }
+  case ExprKind::If: {
+    const IfExpr &I = Pool.getIf(E);
+    infer(I.Cond);
+    ValueType Then = infer(I.Then);
+    return joinTypes(Then, infer(I.Else));
+  }
+  case ExprKind::For: {
+    const ForExpr &F = Pool.getFor(E);
+    ValueType &Slot = Types.Fors[E.getIndex()];
+    // A loop starting at an integer literal counts in ints.
+    // 从整数字面量开始的循环按int计数
+    widen(Slot, F.Start.getKind() == ExprKind::Integer ? ValueType::Int
+                                                       : infer(F.Start));
+
+    SymbolScope<ValueType *> LoopScope(Vars);
+    Vars.bind(F.VarName, &Slot);
+    infer(F.Body);
+    // The variable advances by the step, 1 when not written.
+    // 变量按步长前进，没有写步长时是1
+    widen(Slot, !F.Step || F.Step.getKind() == ExprKind::Integer
+                    ? ValueType::Int
+                    : infer(F.Step));
+    infer(F.End);
+    return ValueType::Double; // for always evaluates to 0.0. for的值总是0.0
+  }
+  case ExprKind::Var: {
+    const VarExpr &V = Pool.getVar(E);
+    SymbolScope<ValueType *> VarScope(Vars);
+    for (unsigned i = 0; i != V.NumBindings; ++i) {
+      const VarBinding &B = Pool.getBindings(V)[i];
+      ValueType &Slot = Types.Bindings[V.FirstBinding + i];
+      // A variable without initializer starts out as zero of whatever type
+      // it turns out to have, so it adds no constraint.
+      // 没有初始化的变量初始值是它最终类型的零，所以不带来约束
+      if (B.IsArray) {
+        infer(B.Init);
+        widen(Slot, ValueType::Array);
+      } else if (B.Init) {
+        widen(Slot, infer(B.Init));
+      }
+      Vars.bind(B.Name, &Slot);
+    }
+    return infer(V.Body);
+  }
+  }
+  llvm_unreachable("unknown expression kind");
+}
+
+/// solve - Run inference on Body to a fixed point, starting from the given
+/// parameter types.
+/// 从给定的参数类型开始，对Body做类型推导直到不动点
+static FunctionTypes solve(const PrototypeAST &Proto, const ExprPool &Pool,
+                           ExprRef Body, std::vector<ValueType> ArgTypes,
+                           ValueType Return, bool Expansion) {
+  FunctionTypes Types;
+  Types.Args = std::move(ArgTypes);
+  Types.Return = Return;
+  Types.Bindings.assign(Pool.numBindings(), ValueType::Int);
+  Types.Fors.assign(Pool.numFors(), ValueType::Int);
+
+  TypeInference Inference(Proto, Pool, Types, Expansion);
+  while (Inference.run(Body))
+    ;
+  return Types;
+}
+
+FunctionTypes inferTypes(const PrototypeAST &Proto, const ExprPool &Pool,
+                         ExprRef Body, ValueType Return) {
+  return solve(Proto, Pool, Body, Proto.getArgTypes(), Return, false);
+}
+
+FunctionTypes inferExpansionTypes(const PrototypeAST &Proto,
+                                  const ExprPool &Pool, ExprRef Body,
+                                  ArrayRef<ValueType> OperandTypes) {
+  std::vector<ValueType> ArgTypes(OperandTypes.begin(), OperandTypes.end());
+  for (unsigned i = 0, e = ArgTypes.size(); i != e; ++i)
+    if (Proto.getArgTypes()[i] == ValueType::Int)
+      ArgTypes[i] = ValueType::Int;
+
+  // Uses of the operator inside its own body are calls, as in codegen.
+  // 和代码生成一样，操作符在自己函数体里的使用是函数调用
+  ++ExpandingOperators[Proto.getName()];
+  FunctionTypes Types =
+      solve(Proto, Pool, Body, std::move(ArgTypes), ValueType::Int, true);
+  --ExpandingOperators[Proto.getName()];
+  return Types;
+}
@@ -0,0 +1,65 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "ast.h"
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+// Type inference
+// 类型推导
+//===----------------------------------------------------------------------===//
+
+/// FunctionTypes - The types inference found for one function body.  A
+/// variable holds an int only if every value it is ever given is an int;
+/// anything else makes it a double.
+/// 类型推导为一个函数体得出的类型。变量只有在被赋予的所有值都是int时才是int，
+/// 否则是double
+struct FunctionTypes {
+  std::vector<ValueType> Args;     // Parameters, as local variables. 参数（作为局部变量）
+  std::vector<ValueType> Bindings; // var/in bindings, by ExprPool index. 变量绑定
+  std::vector<ValueType> Fors;     // for loop variables, by ExprPool index. 循环变量
+  ValueType Return = ValueType::Int;
+};
+
+/// Builtin - The functions the language provides itself.  A call with the
+/// right number of arguments always names the builtin, so functions taking
+/// that many arguments cannot be defined or declared under its name.
+/// 语言自带的函数。参数个数正确的调用总是调用内建函数，所以不能用它的名字定义或声明
+/// 接受同样个数参数的函数
+enum class Builtin : uint8_t {
+  None,
+  Array, // array(n): n zeroed doubles on the heap. 堆上n个置零的double
+  Len,   // len(a): the number of elements of a. a的元素个数
+  Free,  // free(a): release an array from array(). 释放array()分配的数组
+  Vec2,  // vec2(x, y) or vec2(x): a vector of the lanes, or x in each. 向量
+  Vec4,  // vec4(x, y, z, w) or vec4(x).
+  Vec8,  // vec8(...) with 8 lanes, or vec8(x).
+  HSum,  // hsum(v): the sum of the lanes of v. v各通道的和
+  HMin,  // hmin(v): the least lane of v. v最小的通道
+  HMax,  // hmax(v): the greatest lane of v. v最大的通道
+};
+
+/// getBuiltin - The builtin a call to Callee with NumArgs arguments names.
+/// 以NumArgs个参数调用Callee时对应的内建函数
+Builtin getBuiltin(Symbol Callee, size_t NumArgs);
+
+/// inferTypes - Infer the types of the variables and of the result of Body,
+/// the body of Proto.  Calls take the return types recorded in FunctionProtos,
+/// except calls to Proto itself, which use the type being inferred.  The
+/// result only widens from Return, so Double keeps it from being an int.
+/// 推导Proto的函数体Body中变量和结果的类型。函数调用使用FunctionProtos里记录的返回类型，
+/// 但对Proto自身的调用使用正在推导的类型。结果类型只从Return开始放宽，所以Double
+/// 使它不会是int
+FunctionTypes inferTypes(const PrototypeAST &Proto, const ExprPool &Pool,
+                         ExprRef Body, ValueType Return = ValueType::Int);
+
+/// inferExpansionTypes - Infer the types for the body of operator Proto,
+/// expanded where its operands have OperandTypes.  Expansions are generic:
+/// an int parameter is an int, any other takes the type of its operand.
+/// 推导操作符Proto的函数体展开到操作数类型为OperandTypes的地方时的类型。展开是
+/// 泛型的：int参数是int，其他参数采用对应操作数的类型
+FunctionTypes inferExpansionTypes(const PrototypeAST &Proto,
+                                  const ExprPool &Pool, ExprRef Body,
+                                  llvm::ArrayRef<ValueType> OperandTypes);
+
+#endif // TYPES_H